@@ -0,0 +1,93 @@
+/*
+ * Bench - Minimal harness for the native benchmarks
+ *
+ * bench() repeats a function until it has run for at least BENCH_MIN_NS of
+ * host time and reports ns per call plus heap allocations per call (from
+ * the malloc wrappers, see mem_stats.h). Host timings compare variants with
+ * each other; they are not the boards' absolute numbers.
+ *
+ * Simulations instead run on the mocks' virtual clock (see mocks/Arduino.h)
+ * and report firmware-visible milliseconds.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "mem_stats.h"
+
+#define BENCH_MIN_NS  50000000ULL   // 50 ms of host time per measurement
+
+// Keeps the compiler from discarding a result
+template <typename T>
+inline void benchKeep(const T& value) {
+  asm volatile("" : : "r"(&value) : "memory");
+}
+
+inline uint64_t benchNowNs() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct BenchResult {
+  double nsPerOp;
+  double allocsPerOp;
+};
+
+template <typename Fn>
+BenchResult bench(Fn fn) {
+  fn();   // Warm up caches and any lazy init
+  uint64_t iterations = 0;
+  uint32_t allocs = memCounters.allocs;
+  uint64_t start = benchNowNs();
+  uint64_t elapsed = 0;
+  do {
+    for (int i = 0; i < 1000; i++) fn();
+    iterations += 1000;
+    elapsed = benchNowNs() - start;
+  } while (elapsed < BENCH_MIN_NS);
+  BenchResult r;
+  r.nsPerOp = (double)elapsed / iterations;
+  r.allocsPerOp = (double)(memCounters.allocs - allocs) / iterations;
+  return r;
+}
+
+inline void benchSection(const char* title) {
+  printf("\n== %s ==\n", title);
+}
+
+// One line per measurement: name, ns/op, allocations/op, bytes per message
+inline void benchReport(const char* name, const BenchResult& r, size_t bytes = 0) {
+  if (bytes) {
+    printf("%-34s %10.1f ns/op %6.2f allocs/op %5u B\n", name, r.nsPerOp, r.allocsPerOp,
+           (unsigned)bytes);
+  } else {
+    printf("%-34s %10.1f ns/op %6.2f allocs/op\n", name, r.nsPerOp, r.allocsPerOp);
+  }
+}
+
+// Nearest-rank percentile; sorts samples in place
+inline double benchPercentile(std::vector<double>& samples, double pct) {
+  if (samples.empty()) return 0;
+  std::sort(samples.begin(), samples.end());
+  size_t rank = (size_t)(pct / 100.0 * samples.size() + 0.999999);
+  if (rank < 1) rank = 1;
+  return samples[rank - 1];
+}
+
+// Fixture link messages, shared by the suites (bench_codec.cpp)
+size_t benchLinkJsonLine(char* out, size_t size);
+size_t benchLinkKeyframe(uint8_t* out, uint8_t seq);
+size_t benchLinkDelta(uint8_t* out, uint8_t seq, uint8_t mask);
+
+// Suites (one per bench_*.cpp)
+void benchCodec();
+void benchPipeline();
+void benchLink();
+void benchLatency();
+
+#endif // BENCH_H
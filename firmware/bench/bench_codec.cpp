@@ -0,0 +1,232 @@
+/*
+ * Codec benchmarks - Encode/decode cost and size of every message format
+ *
+ * Serial link (R4 <-> ESP8266): the JSON fallback line against the binary
+ * STATE keyframe and DELTA frames. Server API: telemetry POST bodies and the
+ * /api/data response with a piggybacked command, parsed through the same
+ * kind of filter the hub uses. Documents are static or on the stack as in
+ * the firmware, so every path should report 0 allocations.
+ */
+
+#include <Arduino.h>
+#include "bench.h"
+#include "hvac_link.h"
+#include "link_rx.h"
+#include "sensor_filter.h"
+#include "settings_json.h"
+
+namespace {
+
+HVACSettings fixtureSettings() {
+  HVACSettings s;
+  s.power = 1;
+  s.setTemp = 23;
+  s.mode = MODE_COOL;
+  s.fanSpeed = FAN_MEDIUM;
+  s.timer = 0;
+  s.swing = 1;
+  return s;
+}
+
+const HVACSettings kSettings = fixtureSettings();
+const LinkConditions kConditions = { 2345, 5120 };
+
+const char* const kDataResponse =
+  "{\"status\":\"success\",\"timestamp\":\"2026-10-14 12:00:00\",\"schedule_version\":3,"
+  "\"command\":{\"power\":\"on\",\"set_temp\":22,\"mode\":\"cool\",\"fan_speed\":\"high\","
+  "\"timer\":0,\"swing\":\"off\",\"version\":42,\"source\":\"web\","
+  "\"timestamp\":\"2026-10-14 11:59:58\"}}";
+
+// ---- Serial link, JSON fallback ----
+
+// As sendDataToESP() writes it, newline included
+size_t encodeLinkJson(char* out, size_t size) {
+  StaticJsonDocument<512> doc;
+  doc["roomTemp"] = kConditions.temp / 100.0f;
+  doc["roomHumidity"] = kConditions.humidity / 100.0f;
+  writeSettingsJson(doc.createNestedObject("hvac"), kSettings, kLinkJsonKeys);
+  size_t len = serializeJson(doc, out, size - 1);
+  out[len++] = '\n';
+  return len;
+}
+
+// As the hub's handleJsonLine() reads it: in place, from the receive buffer
+bool decodeLinkJson(char* line, HVACSettings& s, float& temp) {
+  StaticJsonDocument<512> doc;
+  if (deserializeJson(doc, line)) return false;
+  temp = doc["roomTemp"];
+  readSettingsJson(doc["hvac"], s, kLinkJsonKeys);
+  return true;
+}
+
+// ---- Serial link, binary ----
+
+size_t encodeKeyframe(uint8_t* out, uint8_t seq) {
+  SensorWindow temp, humidity;
+  temp.add(2340);
+  temp.add(2351);
+  humidity.add(5100);
+  humidity.add(5130);
+
+  uint8_t payload[LINK_MAX_PAYLOAD];
+  linkPutConditions(payload, kConditions);
+  linkPutSettings(payload + LINK_CONDITIONS_SIZE, kSettings);
+  payload[LINK_CONDITIONS_SIZE + LINK_SETTINGS_SIZE] = seq;
+  uint8_t len = LINK_CONDITIONS_SIZE + LINK_SETTINGS_SIZE + 1;
+  linkPutWindow(payload + len, temp, humidity);
+  len += LINK_WINDOW_SIZE;
+  return linkEncodeFrame(LINK_MSG_STATE, payload, len, out);
+}
+
+size_t encodeDelta(uint8_t* out, uint8_t seq, uint8_t mask) {
+  uint8_t payload[LINK_MAX_PAYLOAD];
+  uint8_t len = linkPutDelta(payload, seq, mask, kSettings, kConditions);
+  return linkEncodeFrame(LINK_MSG_DELTA, payload, len, out);
+}
+
+// Through the receiver ring, as received byte by byte from the UART
+bool decodeFrame(LinkReceiver& rx, const uint8_t* bytes, size_t len, HVACSettings& s) {
+  for (size_t i = 0; i < len; i++) rx.write(bytes[i]);
+  if (rx.poll() != LINK_RX_FRAME) return false;
+  uint8_t seq, mask;
+  LinkConditions c;
+  if (rx.frame.type == LINK_MSG_STATE) {
+    linkGetSettings(rx.frame.payload + LINK_CONDITIONS_SIZE, s);
+    return true;
+  }
+  return linkGetDelta(rx.frame.payload, rx.frame.len, seq, mask, s, c);
+}
+
+// ---- Server API ----
+
+// POST /api/data: a conditions-only delta, or a keyframe with every field
+size_t encodeTelemetry(char* out, size_t size, bool keyframe) {
+  static StaticJsonDocument<1536> doc;
+  doc.clear();
+  doc["seq"] = 1234;
+  doc["cmd_version"] = 41;
+  if (keyframe) {
+    doc["keyframe"] = true;
+  }
+  doc["temperature"] = kConditions.temp / 100.0f;
+  doc["humidity"] = kConditions.humidity / 100.0f;
+  if (keyframe) {
+    writeSettingsJson(doc.createNestedObject("hvac"), kSettings, kServerJsonKeys);
+  }
+  return serializeJson(doc, out, size);
+}
+
+// The /api/data response, filtered down to what the hub reads
+struct ResponseFilter {
+  StaticJsonDocument<256> command;
+  StaticJsonDocument<384> data;
+
+  ResponseFilter() {
+    const char* const fields[] = {
+      "version", "source", "power", kServerJsonKeys.setTemp, "mode", kServerJsonKeys.fanSpeed,
+      "timer", "swing"
+    };
+    for (const char* field : fields) {
+      command[field] = true;
+    }
+    data["resync"] = true;
+    data["schedule_version"] = true;
+    data["command"] = command;
+  }
+};
+
+bool decodeDataResponse(const ResponseFilter& filter, const char* body, HVACSettings& s,
+                        bool filtered) {
+  StaticJsonDocument<1024> doc;   // Room for the unfiltered copy too
+  DeserializationError err = filtered
+    ? deserializeJson(doc, body, DeserializationOption::Filter(filter.data))
+    : deserializeJson(doc, body);
+  if (err) return false;
+  readSettingsJson(doc["command"], s, kServerJsonKeys);
+  return doc["schedule_version"].as<uint32_t>() == 3;
+}
+
+}  // namespace
+
+size_t benchLinkJsonLine(char* out, size_t size) { return encodeLinkJson(out, size); }
+size_t benchLinkKeyframe(uint8_t* out, uint8_t seq) { return encodeKeyframe(out, seq); }
+size_t benchLinkDelta(uint8_t* out, uint8_t seq, uint8_t mask) { return encodeDelta(out, seq, mask); }
+
+void benchCodec() {
+  benchSection("codec: serial link (R4 -> ESP)");
+
+  char line[LINK_RX_LINE_SIZE];
+  size_t lineLen = encodeLinkJson(line, sizeof(line));
+  benchReport("json line encode", bench([&]() {
+    char out[LINK_RX_LINE_SIZE];
+    benchKeep(encodeLinkJson(out, sizeof(out)));
+  }), lineLen);
+  benchReport("json line decode", bench([&]() {
+    char scratch[LINK_RX_LINE_SIZE];
+    memcpy(scratch, line, lineLen);
+    scratch[lineLen - 1] = '\0';   // The receiver strips the newline
+    HVACSettings s;
+    float temp;
+    benchKeep(decodeLinkJson(scratch, s, temp));
+    benchKeep(s);
+  }));
+
+  uint8_t keyframe[LINK_MAX_FRAME];
+  uint8_t delta[LINK_MAX_FRAME];
+  uint8_t conditions[LINK_MAX_FRAME];
+  size_t keyframeLen = encodeKeyframe(keyframe, 1);
+  size_t deltaLen = encodeDelta(delta, 2, FIELD_SET_TEMP);
+  size_t conditionsLen = encodeDelta(conditions, 3, LINK_DELTA_CONDITIONS);
+
+  benchReport("binary keyframe encode", bench([&]() {
+    uint8_t out[LINK_MAX_FRAME];
+    benchKeep(encodeKeyframe(out, 1));
+  }), keyframeLen);
+  benchReport("binary setpoint delta encode", bench([&]() {
+    uint8_t out[LINK_MAX_FRAME];
+    benchKeep(encodeDelta(out, 2, FIELD_SET_TEMP));
+  }), deltaLen);
+  benchReport("binary conditions delta encode", bench([&]() {
+    uint8_t out[LINK_MAX_FRAME];
+    benchKeep(encodeDelta(out, 3, LINK_DELTA_CONDITIONS));
+  }), conditionsLen);
+
+  LinkReceiver rx;
+  benchReport("binary keyframe decode", bench([&]() {
+    HVACSettings s;
+    benchKeep(decodeFrame(rx, keyframe, keyframeLen, s));
+    benchKeep(s);
+  }));
+  benchReport("binary setpoint delta decode", bench([&]() {
+    HVACSettings s;
+    benchKeep(decodeFrame(rx, delta, deltaLen, s));
+    benchKeep(s);
+  }));
+
+  benchSection("codec: server API (ESP <-> server)");
+
+  char body[1024];
+  size_t deltaBody = encodeTelemetry(body, sizeof(body), false);
+  size_t keyframeBody = encodeTelemetry(body, sizeof(body), true);
+  benchReport("telemetry delta encode", bench([&]() {
+    char out[1024];
+    benchKeep(encodeTelemetry(out, sizeof(out), false));
+  }), deltaBody);
+  benchReport("telemetry keyframe encode", bench([&]() {
+    char out[1024];
+    benchKeep(encodeTelemetry(out, sizeof(out), true));
+  }), keyframeBody);
+
+  ResponseFilter filter;
+  size_t responseLen = strlen(kDataResponse);
+  benchReport("data response decode (filtered)", bench([&]() {
+    HVACSettings s;
+    benchKeep(decodeDataResponse(filter, kDataResponse, s, true));
+    benchKeep(s);
+  }), responseLen);
+  benchReport("data response decode (unfiltered)", bench([&]() {
+    HVACSettings s;
+    benchKeep(decodeDataResponse(filter, kDataResponse, s, false));
+    benchKeep(s);
+  }), responseLen);
+}
@@ -0,0 +1,231 @@
+/*
+ * Latency simulation - Web command to IR and to the R4's display
+ *
+ * A command is issued on the web page at a random moment and followed on the
+ * virtual clock through the same stages as the firmware:
+ *
+ *   server -> hub      polling every commandCheckInterval, or the push
+ *                      long-poll answered as soon as the command lands;
+ *                      the hub's blocking telemetry POSTs delay either
+ *   hub -> AC          IR coalescing window, then the send's airtime
+ *   hub -> R4          the settings over the serial link (binary delta or
+ *                      JSON line), then the next display tick and the
+ *                      partial OLED flush; once per rate in kLinkBauds,
+ *                      since the link may have settled at any of them
+ *
+ * SimConfig takes the firmware's intervals from hvac_timing.h, the header
+ * main.cpp builds with. Trials use a fixed seed so runs are comparable.
+ */
+
+#include <Arduino.h>
+#include <ESP8266HTTPClient.h>
+#include <IRsend.h>
+#include <U8g2lib.h>
+#include <random>
+#include "bench.h"
+#include "hvac_link.h"
+#include "link_baud.h"
+#include "hvac_timing.h"
+#include "link_rx.h"
+#include "settings_json.h"
+
+namespace {
+
+struct SimConfig {
+  uint32_t commandCheckMs = commandCheckInterval;
+  uint32_t serverUpdateMs = serverUpdateInterval;     // A POST while changes are pending
+  uint32_t serverKeyframeMs = serverKeyframeInterval;
+  uint32_t pushWaitMs = pushWaitSeconds * 1000;
+  uint32_t rttMs = 40;                                // Wi-Fi + server round trip
+  uint32_t irCoalesceMs = irCoalesceWindow;
+  uint32_t displayMs = displayInterval;               // On the R4
+};
+
+const int kTrials = 1000;
+
+// The server side of /api/data: holds one pending command from issuedAt on
+class WebServer : public MockHttpServer {
+public:
+  uint64_t issuedAt = 0;
+  bool delivered = false;
+
+  int handle(const char* method, const std::string& url, const std::string& body,
+             std::string& response, uint32_t& holdMs) override {
+    (void)url; (void)body; (void)holdMs;
+    // The request reaches the server half a round trip after it was sent
+    bool pending = !delivered &&
+                   MockClock::us() + HTTPClient::rttMs() * 500ULL >= issuedAt;
+    if (strcmp(method, "GET") == 0 && pending) {
+      delivered = true;
+      response = "{\"command\":{\"set_temp\":22,\"version\":42}}";
+    } else {
+      response = "{\"status\":\"success\"}";
+    }
+    return HTTP_CODE_OK;
+  }
+};
+
+void httpRequest(const char* method) {
+  WiFiClient client;
+  HTTPClient http;
+  http.begin(client, "/api/data");
+  if (strcmp(method, "GET") == 0) {
+    http.GET();
+  } else {
+    http.POST("{\"seq\":1}");
+  }
+  http.end();
+}
+
+// Stage 1: until the hub has the command. Returns the arrival time in us.
+uint64_t simulateHub(const SimConfig& cfg, bool push, uint64_t issuedAt, uint64_t phaseUs) {
+  WebServer server;
+  server.issuedAt = issuedAt;
+  HTTPClient::server() = &server;
+  HTTPClient::rttMs() = cfg.rttMs;
+
+  uint64_t nextPoll = phaseUs % (cfg.commandCheckMs * 1000ULL);
+  uint64_t nextPost = phaseUs % (cfg.serverUpdateMs * 1000ULL);
+  // Push: the held long-poll answers when the command lands and the reply
+  // is back half a round trip later; the hub sees it on its next loop pass
+  uint64_t pushArrives = issuedAt + cfg.rttMs * 500ULL;
+
+  for (;;) {
+    uint64_t now = MockClock::us();
+    if (push && now >= pushArrives) break;
+    if (now >= nextPost) {
+      httpRequest("POST");   // R4 conditions changing: telemetry posts every interval
+      nextPost += cfg.serverUpdateMs * 1000ULL;
+      continue;
+    }
+    if (!push && now >= nextPoll) {
+      httpRequest("GET");
+      nextPoll += cfg.commandCheckMs * 1000ULL;
+      if (server.delivered) break;
+      continue;
+    }
+    MockClock::advanceUs(1000);   // One loop pass
+  }
+  HTTPClient::server() = nullptr;
+  return MockClock::us();
+}
+
+// Stage 2: IR out of the hub, coalescing window first
+uint64_t simulateIR(const SimConfig& cfg, uint64_t hubAt) {
+  MockClock::reset();
+  MockClock::advanceUs(hubAt);
+  IRsend ir;
+  uint8_t state[35] = {};
+  MockClock::advanceMs(cfg.irCoalesceMs);
+  ir.sendDaikin(state, sizeof(state));
+  return MockClock::us();
+}
+
+// Stage 3: over the link to the R4 and onto its display
+uint64_t simulateDisplay(const SimConfig& cfg, uint32_t baud, bool binary, uint64_t hubAt,
+                         uint64_t phaseUs) {
+  MockClock::reset();
+  MockClock::advanceUs(hubAt);
+  HardwareSerial hub;
+  HardwareSerial r4;
+  hub.begin(baud);
+  r4.begin(baud);
+  hub.connect(r4);
+
+  HVACSettings s;
+  s.setTemp = 22;
+  if (binary) {
+    uint8_t payload[LINK_MAX_PAYLOAD];
+    uint8_t frame[LINK_MAX_FRAME];
+    LinkConditions none = { 0, 0 };
+    uint8_t len = linkPutDelta(payload, 7, FIELD_SET_TEMP, s, none);
+    hub.write(frame, linkEncodeFrame(LINK_MSG_DELTA, payload, len, frame));
+  } else {
+    StaticJsonDocument<512> doc;
+    writeSettingsJson(doc.createNestedObject("hvac"), s, kLinkJsonKeys);
+    char line[LINK_RX_LINE_SIZE];
+    size_t len = serializeJson(doc, line, sizeof(line) - 1);
+    line[len++] = '\n';
+    hub.write((const uint8_t*)line, len);
+  }
+
+  // R4 loop: drain the UART each pass until the message is complete
+  LinkReceiver rx;
+  for (;;) {
+    while (r4.available() > 0 && !rx.full()) {
+      rx.write((uint8_t)r4.read());
+    }
+    if (rx.poll() != LINK_RX_NONE) break;
+    MockClock::advanceUs(200);
+  }
+
+  // Next display tick, then the setpoint digits' tiles only
+  uint64_t period = cfg.displayMs * 1000ULL;
+  uint64_t now = MockClock::us();
+  uint64_t tick = now - (now + phaseUs) % period + period;
+  MockClock::advanceUs(tick - now);
+  U8G2 display;
+  display.updateDisplayArea(4, 2, 8, 3);
+  return MockClock::us();
+}
+
+void reportStage(const char* name, std::vector<double>& ms) {
+  double p50 = benchPercentile(ms, 50);
+  double p95 = benchPercentile(ms, 95);
+  printf("  %-22s p50 %7.1f ms   p95 %7.1f ms   max %7.1f ms\n", name, p50, p95, ms.back());
+}
+
+void runVariant(const SimConfig& cfg, bool push, bool binary) {
+  std::mt19937 rng(12345);
+  std::uniform_int_distribution<uint32_t> phase(0, 60000000);
+  std::uniform_int_distribution<uint32_t> offset(0, 2000000);
+  std::vector<double> hub, ir, display[LINK_BAUD_COUNT];
+  for (int i = 0; i < kTrials; i++) {
+    uint64_t phaseUs = phase(rng);
+    uint64_t issuedAt = 5000000 + offset(rng);   // After start-up
+    MockClock::reset();
+    uint64_t hubAt = simulateHub(cfg, push, issuedAt, phaseUs);
+    uint64_t irAt = simulateIR(cfg, hubAt);
+    hub.push_back((hubAt - issuedAt) / 1000.0);
+    ir.push_back((irAt - issuedAt) / 1000.0);
+    for (uint8_t b = 0; b < LINK_BAUD_COUNT; b++) {
+      uint64_t displayAt = simulateDisplay(cfg, kLinkBauds[b], binary, hubAt, phaseUs);
+      display[b].push_back((displayAt - issuedAt) / 1000.0);
+    }
+  }
+  printf("%s, %s link\n", push ? "push" : "polling", binary ? "binary" : "json");
+  reportStage("command at hub", hub);
+  reportStage("IR sent", ir);
+  for (uint8_t b = 0; b < LINK_BAUD_COUNT; b++) {
+    char name[24];
+    snprintf(name, sizeof(name), "R4 display @ %lu", (unsigned long)kLinkBauds[b]);
+    reportStage(name, display[b]);
+  }
+}
+
+// HTTP requests per minute with nothing happening: the keyframe heartbeat
+// plus either the command polls or the long-poll re-issued as it expires
+void reportIdleRequests(const SimConfig& cfg) {
+  double keyframes = 60000.0 / cfg.serverKeyframeMs;
+  double poll = keyframes + 60000.0 / (cfg.commandCheckMs + cfg.rttMs);
+  double push = keyframes + 60000.0 / (cfg.pushWaitMs + cfg.rttMs);
+  printf("  %-22s %7.1f req/min\n", "polling", poll);
+  printf("  %-22s %7.1f req/min\n", "push", push);
+}
+
+}  // namespace
+
+void benchLatency() {
+  SimConfig cfg;
+  char title[96];
+  snprintf(title, sizeof(title), "latency: web command -> AC and R4 (%d trials)", kTrials);
+  benchSection(title);
+  runVariant(cfg, false, false);
+  runVariant(cfg, false, true);
+  runVariant(cfg, true, false);
+  runVariant(cfg, true, true);
+
+  benchSection("latency: idle server load");
+  reportIdleRequests(cfg);
+  MockClock::reset();
+}
@@ -0,0 +1,130 @@
+/*
+ * Link benchmarks - Serial throughput of the R4 -> ESP8266 link per baud rate
+ *
+ * For each rate: wire time and the message rate the link can carry for the
+ * JSON fallback line, the binary keyframe and a setpoint delta. Then a
+ * simulation on the virtual clock: the R4 sends on every knob step (one per
+ * deltaMinGap) while the hub's loop stalls in a blocking HTTP POST every
+ * second. Bytes arriving during the stall wait in the hub's UART FIFO; what
+ * doesn't fit is lost, and with it the message.
+ */
+
+#include <Arduino.h>
+#include "bench.h"
+#include "hvac_link.h"
+#include "link_rx.h"
+
+namespace {
+
+const uint32_t kBauds[] = { 9600, 19200, 38400, 57600, 115200, 230400, 460800 };
+
+const uint32_t kSendEveryMs = 50;      // deltaMinGap on the R4
+const uint32_t kStallEveryMs = 1000;
+const uint32_t kRunMs = 10000;
+const uint32_t kDrainMs = 5000;        // Let the wire empty before counting
+const uint32_t kLoopStepUs = 250;      // Hub loop pass while not stalled
+const uint16_t kEspRxFifo = 1024;      // Serial.setRxBufferSize() in the hub's setup()
+
+struct LinkRun {
+  uint32_t sent;
+  uint32_t received;
+  uint32_t overruns;   // Bytes dropped by the FIFO
+  uint32_t backlogMs;  // Sender's queue at the end of the run, in wire time
+};
+
+double wireMs(size_t bytes, uint32_t baud) {
+  return bytes * 10000.0 / baud;   // 8N1: 10 bits a byte
+}
+
+LinkRun simulate(uint32_t baud, const uint8_t* msg, size_t len, uint32_t stallMs) {
+  MockClock::reset();
+  HardwareSerial r4;
+  HardwareSerial esp;
+  r4.begin(baud);
+  esp.begin(baud);
+  esp.fifoSize = kEspRxFifo;
+  r4.connect(esp);
+  LinkReceiver rx;
+
+  LinkRun run = { 0, 0, 0, 0 };
+  uint64_t nextSend = 0;
+  uint64_t nextStall = (uint64_t)kStallEveryMs * 1000;
+  uint64_t stalledUntil = 0;
+  uint64_t end = (uint64_t)(kRunMs + kDrainMs) * 1000;
+
+  while (MockClock::us() < end) {
+    uint64_t now = MockClock::us();
+    if (now < (uint64_t)kRunMs * 1000 && now >= nextSend) {
+      r4.write(msg, len);
+      run.sent++;
+      nextSend += (uint64_t)kSendEveryMs * 1000;
+    }
+    if (now >= nextStall && now < (uint64_t)kRunMs * 1000) {
+      stalledUntil = now + (uint64_t)stallMs * 1000;
+      nextStall += (uint64_t)kStallEveryMs * 1000;
+    }
+    if (now >= stalledUntil) {
+      // receiveFromArduino()
+      while (esp.available() > 0 && !rx.full()) {
+        rx.write((uint8_t)esp.read());
+      }
+      LinkRxEvent event;
+      while ((event = rx.poll()) != LINK_RX_NONE) {
+        run.received++;
+      }
+    }
+    if (MockClock::us() == (uint64_t)kRunMs * 1000 - kLoopStepUs) {
+      run.backlogMs = (uint32_t)(r4.txDrainUs() / 1000);
+    }
+    MockClock::advanceUs(kLoopStepUs);
+  }
+  run.overruns = esp.overruns;
+  return run;
+}
+
+void reportRun(const char* name, const LinkRun& r) {
+  printf("  %-16s %4u/%-4u delivered %6u B overrun", name, (unsigned)r.received,
+         (unsigned)r.sent, (unsigned)r.overruns);
+  if (r.backlogMs > 0) {
+    printf("   (link saturated, %u ms queued)", (unsigned)r.backlogMs);
+  }
+  printf("\n");
+}
+
+}  // namespace
+
+void benchLink() {
+  char line[LINK_RX_LINE_SIZE];
+  uint8_t keyframe[LINK_MAX_FRAME];
+  uint8_t delta[LINK_MAX_FRAME];
+  size_t lineLen = benchLinkJsonLine(line, sizeof(line));
+  size_t keyframeLen = benchLinkKeyframe(keyframe, 1);
+  size_t deltaLen = benchLinkDelta(delta, 2, FIELD_SET_TEMP);
+
+  benchSection("link: wire time per message (8N1)");
+  printf("%-8s %22s %22s %22s\n", "baud", "json line", "binary keyframe", "binary delta");
+  printf("%-8s %14u B      %14u B      %14u B\n", "", (unsigned)lineLen,
+         (unsigned)keyframeLen, (unsigned)deltaLen);
+  for (uint32_t baud : kBauds) {
+    printf("%-8u", (unsigned)baud);
+    for (size_t len : { lineLen, keyframeLen, deltaLen }) {
+      double ms = wireMs(len, baud);
+      printf(" %7.2f ms %6.0f msg/s", ms, 1000.0 / ms);
+    }
+    printf("\n");
+  }
+
+  const uint32_t stalls[] = { 50, 300 };
+  for (uint32_t stallMs : stalls) {
+    char title[96];
+    snprintf(title, sizeof(title), "link: knob spin (%u msg/s), hub stalled %u ms every %u ms",
+             (unsigned)(1000 / kSendEveryMs), (unsigned)stallMs, (unsigned)kStallEveryMs);
+    benchSection(title);
+    for (uint32_t baud : kBauds) {
+      printf("%u baud\n", (unsigned)baud);
+      reportRun("json line", simulate(baud, (const uint8_t*)line, lineLen, stallMs));
+      reportRun("binary delta", simulate(baud, delta, deltaLen, stallMs));
+    }
+  }
+  MockClock::reset();
+}
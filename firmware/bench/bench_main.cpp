@@ -0,0 +1,56 @@
+/*
+ * Native benchmarks for the shared firmware logic
+ *
+ *   pio run -e native && .pio/build/native/program [suite]
+ *
+ * Suites: codec, pipeline, link, latency (all of them by default). The
+ * native build compiles src/main.cpp with neither board defined, so only
+ * its shared section is linked in, next to the headers in include/ and the
+ * hardware mocks in bench/mocks/.
+ */
+
+#include <Arduino.h>
+#include <new>
+#include "bench.h"
+
+MockConsole Serial;
+
+// Send C++ allocations through malloc so the wrappers count them as well
+void* operator new(size_t size) {
+  void* p = malloc(size ? size : 1);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+struct BenchSuite {
+  const char* name;
+  void (*run)();
+};
+
+const BenchSuite kSuites[] = {
+  { "codec", benchCodec },
+  { "pipeline", benchPipeline },
+  { "link", benchLink },
+  { "latency", benchLatency },
+};
+
+int main(int argc, char** argv) {
+  const char* only = argc > 1 ? argv[1] : nullptr;
+  bool ran = false;
+  for (const BenchSuite& suite : kSuites) {
+    if (only == nullptr || strcmp(only, suite.name) == 0) {
+      suite.run();
+      ran = true;
+    }
+  }
+  if (!ran) {
+    fprintf(stderr, "Unknown suite '%s' (codec, pipeline, link, latency)\n", only);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * Pipeline benchmarks - Per-cycle cost of the code that runs every loop pass
+ *
+ * DHT22 decode and the sensor filter chain (once per reading on the R4),
+ * the thermostat step, a scheduler pass with the hub's task mix, IR cache
+ * lookups, profiler spans and the link CRC.
+ */
+
+#include <Arduino.h>
+#include "bench.h"
+#include "dht22_frame.h"
+#include "hvac_link.h"
+#include "lru_cache.h"
+#include "mock_dht22.h"
+#include "profiler.h"
+#include "sensor_filter.h"
+#include "task_scheduler.h"
+#include "thermostat.h"
+
+namespace {
+
+volatile uint32_t taskRuns = 0;
+void noopTask() { taskRuns = taskRuns + 1; }
+
+}  // namespace
+
+void benchPipeline() {
+  benchSection("pipeline: sensor (R4, per reading)");
+
+  Dht22Capture capture;
+  mockDht22Capture(capture, 234, 512);
+  benchReport("dht22 frame decode", bench([&]() {
+    Dht22Reading reading;
+    benchKeep(capture.decode(reading));
+    benchKeep(reading);
+  }));
+
+  SensorFilter filter(50, 2);
+  SensorDeadband deadband(20, 300000);
+  SensorWindow window;
+  int16_t raw = 230;
+  uint32_t now = 0;
+  benchReport("filter + deadband + window", bench([&]() {
+    raw = (int16_t)(raw == 236 ? 230 : raw + 1);   // Sawtooth within the deadband
+    filter.add(raw);
+    int16_t v = filter.value();
+    window.add(v);
+    if (window.count == 0xFFFF) window.reset();
+    benchKeep(deadband.update(v, now += 2000));
+  }));
+
+  benchSection("pipeline: hub (ESP8266, per step)");
+
+  ThermostatConfig config = { 50, 256, 109, 300, 100, 200, 180000, 180000 };
+  Thermostat thermostat(config);
+  HVACSettings user;
+  user.mode = MODE_COOL;
+  user.fanSpeed = FAN_AUTO;
+  int16_t room = 2400;
+  benchReport("thermostat update + apply", bench([&]() {
+    room = (int16_t)(room >= 2500 ? 2350 : room + 3);
+    thermostat.update(user, room, now += 5000);
+    HVACSettings out = thermostat.apply(user);
+    benchKeep(out);
+  }));
+
+  // The hub's mix: 3 critical every pass, the rest periodic and mostly idle
+  TaskScheduler<10> scheduler([]() -> uint32_t { return millis(); });
+  scheduler.every("link_rx", noopTask, 0, TASK_CRITICAL);
+  scheduler.every("link_tx", noopTask, 0, TASK_CRITICAL);
+  scheduler.every("ir", noopTask, 0, TASK_CRITICAL);
+  scheduler.every("wifi", noopTask, 100, TASK_HIGH);
+  scheduler.every("push", noopTask, 0, TASK_HIGH);
+  scheduler.every("server", noopTask, 2000, TASK_NORMAL);
+  scheduler.every("commands", noopTask, 500, TASK_NORMAL);
+  scheduler.every("thermostat", noopTask, 5000, TASK_NORMAL);
+  scheduler.oneShot("schedule", noopTask, TASK_NORMAL);
+  scheduler.every("backlog", noopTask, 500, TASK_BULK);
+  benchReport("scheduler pass (10 tasks)", bench([&]() {
+    MockClock::advanceUs(100);
+    scheduler.run();
+  }));
+
+  struct Frame { uint8_t state[35]; };
+  LruCache<Frame, 8> cache;
+  for (uint32_t k = 0; k < 8; k++) cache.insert(k * 7919);
+  uint32_t key = 0;
+  benchReport("ir cache lookup (8 entries)", bench([&]() {
+    key = (key + 1) % 10;   // 8 hits, 2 misses
+    Frame* f = cache.find(key * 7919);
+    if (f == nullptr) cache.insert(key * 7919);
+    benchKeep(f);
+  }));
+
+  ProfileSpan span("bench");
+  uint32_t us = 0;
+  benchReport("profile span record", bench([&]() {
+    span.record(us = (us * 1103515245u + 12345u) & 0x3FFF);
+    benchKeep(span);
+  }));
+
+  uint8_t frame[LINK_MAX_FRAME] = {};
+  benchReport("link crc16 (32 B payload)", bench([&]() {
+    benchKeep(linkCrc16(frame + 1, LINK_MAX_PAYLOAD + 2));
+  }));
+}
@@ -0,0 +1,181 @@
+/*
+ * Arduino.h (native mock) - Just enough of the Arduino core for host builds
+ *
+ * millis()/micros() read a virtual clock that only moves when a simulation
+ * advances it, so timing-dependent logic runs deterministically and faster
+ * than real time. Benchmarks time CPU work with the host clock instead
+ * (see bench.h).
+ *
+ * HardwareSerial models a UART: bytes written to one end arrive at the
+ * connected end after their wire time at the configured baud rate (10 bits
+ * per byte, 8N1), and bytes that arrive while the receive FIFO is full are
+ * dropped, as on the boards.
+ */
+
+#ifndef MOCK_ARDUINO_H
+#define MOCK_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <deque>
+
+// ----------------------------------------------------------------------------
+// Virtual clock
+// ----------------------------------------------------------------------------
+
+struct MockClock {
+  static uint64_t& us() {
+    static uint64_t now = 0;
+    return now;
+  }
+  static void advanceUs(uint64_t d) { us() += d; }
+  static void advanceMs(uint32_t d) { us() += (uint64_t)d * 1000; }
+  static void reset() { us() = 0; }
+};
+
+inline unsigned long millis() { return (unsigned long)(MockClock::us() / 1000); }
+inline unsigned long micros() { return (unsigned long)MockClock::us(); }
+inline void delay(unsigned long ms) { MockClock::advanceMs(ms); }
+inline void yield() {}
+
+// ----------------------------------------------------------------------------
+// Print / Stream
+// ----------------------------------------------------------------------------
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t b) = 0;
+  virtual size_t write(const uint8_t* buf, size_t len) {
+    size_t n = 0;
+    while (len--) n += write(*buf++);
+    return n;
+  }
+  size_t print(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+  size_t print(long v) { return printNumber("%ld", v); }
+  size_t print(unsigned long v) { return printNumber("%lu", v); }
+  size_t print(int v) { return print((long)v); }
+  size_t print(unsigned int v) { return print((unsigned long)v); }
+  size_t print(double v) { return printNumber("%.2f", v); }
+  size_t println() { return print("\r\n"); }
+  template <typename T>
+  size_t println(T v) { return print(v) + println(); }
+
+private:
+  template <typename T>
+  size_t printNumber(const char* format, T v) {
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), format, v);
+    return write((const uint8_t*)buf, (size_t)len);
+  }
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  size_t readBytes(char* buf, size_t len) {
+    size_t n = 0;
+    while (n < len && available() > 0) buf[n++] = (char)read();
+    return n;
+  }
+};
+
+// ----------------------------------------------------------------------------
+// UART
+// ----------------------------------------------------------------------------
+
+#define MOCK_UART_FIFO  64   // Receive buffer; the cores use 64 (ESP8266: 256 by default)
+
+class HardwareSerial : public Stream {
+public:
+  HardwareSerial* peer = nullptr;
+  uint32_t baud = 0;
+  uint16_t fifoSize = MOCK_UART_FIFO;
+  uint32_t overruns = 0;      // Bytes lost to a full receive FIFO
+  uint32_t txBytes = 0;
+
+  void begin(uint32_t rate) { baud = rate; }
+  void end() {}
+  void connect(HardwareSerial& other) {
+    peer = &other;
+    other.peer = this;
+  }
+
+  // Microseconds one byte occupies the wire
+  uint32_t byteTimeUs() const { return baud ? 10000000UL / baud : 0; }
+
+  size_t write(uint8_t b) override {
+    txBytes++;
+    if (peer == nullptr) return 1;
+    // Bytes leave back to back: each starts when the previous one finished
+    uint64_t start = txBusyUntil > MockClock::us() ? txBusyUntil : MockClock::us();
+    txBusyUntil = start + byteTimeUs();
+    peer->inFlight.push_back(Pending{ txBusyUntil, b });
+    return 1;
+  }
+  using Print::write;
+
+  int available() override {
+    deliver();
+    return (int)rx.size();
+  }
+
+  int read() override {
+    deliver();
+    if (rx.empty()) return -1;
+    uint8_t b = rx.front();
+    rx.pop_front();
+    return b;
+  }
+
+  int peek() override {
+    deliver();
+    return rx.empty() ? -1 : rx.front();
+  }
+
+  // Time until everything written so far has left the wire
+  uint64_t txDrainUs() const {
+    return txBusyUntil > MockClock::us() ? txBusyUntil - MockClock::us() : 0;
+  }
+
+private:
+  struct Pending {
+    uint64_t at;   // Arrival time (us)
+    uint8_t b;
+  };
+  std::deque<Pending> inFlight;
+  std::deque<uint8_t> rx;
+  uint64_t txBusyUntil = 0;
+
+  void deliver() {
+    while (!inFlight.empty() && inFlight.front().at <= MockClock::us()) {
+      if (rx.size() < fifoSize) {
+        rx.push_back(inFlight.front().b);
+      } else {
+        overruns++;
+      }
+      inFlight.pop_front();
+    }
+  }
+};
+
+// Console output for anything that prints to Serial
+class MockConsole : public HardwareSerial {
+public:
+  bool echo = false;
+  size_t write(uint8_t b) override {
+    if (echo) putchar(b);
+    return 1;
+  }
+  using Print::write;
+};
+
+extern MockConsole Serial;
+
+#endif // MOCK_ARDUINO_H
@@ -0,0 +1,75 @@
+/*
+ * ESP8266HTTPClient.h (native mock) - Blocking HTTP calls against a fake server
+ *
+ * Each GET/POST hands the request to a MockHttpServer and, like the real
+ * client, blocks for the round trip: the virtual clock advances by
+ * rttMs plus whatever the server adds (a long-poll holding the request, for
+ * instance). The response body is read back through getStream().
+ */
+
+#ifndef MOCK_ESP8266HTTPCLIENT_H
+#define MOCK_ESP8266HTTPCLIENT_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <string>
+
+#define HTTP_CODE_OK            200
+#define HTTP_CODE_NOT_MODIFIED  304
+
+class MockHttpServer {
+public:
+  virtual ~MockHttpServer() {}
+  // Returns the status code; may set holdMs to keep the request open
+  virtual int handle(const char* method, const std::string& url, const std::string& body,
+                     std::string& response, uint32_t& holdMs) = 0;
+};
+
+class HTTPClient {
+public:
+  static MockHttpServer*& server() {
+    static MockHttpServer* s = nullptr;
+    return s;
+  }
+  static uint32_t& rttMs() {
+    static uint32_t rtt = 40;
+    return rtt;
+  }
+  static uint32_t& requests() {
+    static uint32_t n = 0;
+    return n;
+  }
+
+  bool begin(WiFiClient& client, const char* url) {
+    this->client = &client;
+    this->url = url;
+    return true;
+  }
+  void addHeader(const char*, const char*) {}
+  void setReuse(bool) {}
+  void setTimeout(uint16_t) {}
+  void end() {}
+
+  int GET() { return send("GET", std::string()); }
+  int POST(const uint8_t* body, size_t len) { return send("POST", std::string((const char*)body, len)); }
+  int POST(const char* body) { return send("POST", std::string(body)); }
+
+  WiFiClient& getStream() { return *client; }
+  int getSize() const { return (int)client->data.size(); }
+
+private:
+  WiFiClient* client = nullptr;
+  std::string url;
+
+  int send(const char* method, const std::string& body) {
+    requests()++;
+    std::string response;
+    uint32_t holdMs = 0;
+    int code = server() ? server()->handle(method, url, body, response, holdMs) : -1;
+    MockClock::advanceMs(rttMs() + holdMs);
+    client->load(response);
+    return code;
+  }
+};
+
+#endif // MOCK_ESP8266HTTPCLIENT_H
@@ -0,0 +1,33 @@
+/*
+ * ESP8266WiFi.h (native mock) - WiFiClient as a plain byte stream
+ *
+ * HTTPClient (see ESP8266HTTPClient.h) fills it with the response body; no
+ * sockets are involved.
+ */
+
+#ifndef MOCK_ESP8266WIFI_H
+#define MOCK_ESP8266WIFI_H
+
+#include <Arduino.h>
+#include <string>
+
+class WiFiClient : public Stream {
+public:
+  std::string data;
+  size_t pos = 0;
+
+  void load(const std::string& body) {
+    data = body;
+    pos = 0;
+  }
+
+  size_t write(uint8_t) override { return 1; }
+  using Print::write;
+  int available() override { return (int)(data.size() - pos); }
+  int read() override { return pos < data.size() ? (uint8_t)data[pos++] : -1; }
+  int peek() override { return pos < data.size() ? (uint8_t)data[pos] : -1; }
+  bool connected() const { return pos < data.size(); }
+  void stop() { load(std::string()); }
+};
+
+#endif // MOCK_ESP8266WIFI_H
@@ -0,0 +1,38 @@
+/*
+ * IRsend.h (native mock) - Counts IR sends and models their airtime
+ *
+ * A send blocks for its airtime on the real hardware (the carrier is bit-
+ * banged), so the mock advances the virtual clock by the same amount.
+ */
+
+#ifndef MOCK_IRSEND_H
+#define MOCK_IRSEND_H
+
+#include <Arduino.h>
+
+// Daikin ARC style: 35 state bytes in three sections with gaps, ~130 ms on air
+#define MOCK_IR_AIRTIME_MS  130
+
+class IRsend {
+public:
+  uint32_t sends = 0;
+  uint32_t airtimeMs = MOCK_IR_AIRTIME_MS;
+  uint8_t last[64];
+  uint16_t lastLength = 0;
+
+  explicit IRsend(uint16_t pin = 0) { (void)pin; }
+  void begin() {}
+
+  void sendRaw(const uint8_t* state, uint16_t length) {
+    lastLength = length > sizeof(last) ? sizeof(last) : length;
+    memcpy(last, state, lastLength);
+    sends++;
+    MockClock::advanceMs(airtimeMs);
+  }
+
+  void sendDaikin(const uint8_t* state, uint16_t length) { sendRaw(state, length); }
+  void sendMitsubishiAC(const uint8_t* state, uint16_t length) { sendRaw(state, length); }
+  void sendGree(const uint8_t* state, uint16_t length) { sendRaw(state, length); }
+};
+
+#endif // MOCK_IRSEND_H
@@ -0,0 +1,94 @@
+/*
+ * U8g2lib.h (native mock) - 128x64 frame buffer with SPI transfer accounting
+ *
+ * Drawing is approximate: text stamps one byte per character cell and
+ * boxes fill whole bytes, which is enough for change-detection and transfer
+ * sizes to behave like the real panel. Transfers advance the virtual clock
+ * at the SPI clock rate.
+ */
+
+#ifndef MOCK_U8G2LIB_H
+#define MOCK_U8G2LIB_H
+
+#include <Arduino.h>
+
+#define U8G2_R0  0
+#define u8g2_font_5x7_tr    ((const uint8_t*)"5x7")
+#define u8g2_font_6x10_tr   ((const uint8_t*)"6x10")
+#define u8g2_font_10x20_tr  ((const uint8_t*)"10x20")
+
+#define MOCK_OLED_WIDTH   128
+#define MOCK_OLED_TILES_Y 8
+#define MOCK_SPI_HZ       8000000UL
+
+class U8G2 {
+public:
+  uint8_t buffer[MOCK_OLED_WIDTH * MOCK_OLED_TILES_Y];
+  uint32_t bytesSent = 0;
+  uint32_t transfers = 0;
+
+  U8G2() { memset(buffer, 0, sizeof(buffer)); }
+
+  bool begin() { return true; }
+  void setFont(const uint8_t* font) { charWidth = font && font[0] == '1' ? 10 : 6; }
+  void setDrawColor(uint8_t c) { color = c; }
+
+  void clearBuffer() { memset(buffer, 0, sizeof(buffer)); }
+  void sendBuffer() { transfer(sizeof(buffer)); }
+  void updateDisplayArea(uint8_t tx, uint8_t ty, uint8_t tw, uint8_t th) {
+    (void)tx; (void)ty;
+    transfer((uint32_t)tw * th * 8);
+  }
+
+  uint8_t* getBufferPtr() { return buffer; }
+  uint8_t getBufferTileWidth() const { return MOCK_OLED_WIDTH / 8; }
+  uint8_t getBufferTileHeight() const { return MOCK_OLED_TILES_Y; }
+
+  int getStrWidth(const char* s) const { return (int)strlen(s) * charWidth; }
+
+  int drawStr(int x, int y, const char* s) {
+    int width = getStrWidth(s);
+    for (; *s; s++, x += charWidth) {
+      stamp(x, y, (uint8_t)*s);
+    }
+    return width;
+  }
+
+  void drawBox(int x, int y, int w, int h) {
+    for (int yy = y; yy < y + h; yy += 8) {
+      for (int xx = x; xx < x + w; xx++) stamp(xx, yy, 0xFF);
+    }
+  }
+
+  void drawFrame(int x, int y, int w, int h) {
+    for (int xx = x; xx < x + w; xx++) {
+      stamp(xx, y, 0x01);
+      stamp(xx, y + h - 1, 0x80);
+    }
+  }
+
+private:
+  uint8_t charWidth = 6;
+  uint8_t color = 1;
+
+  void stamp(int x, int y, uint8_t bits) {
+    if (x < 0 || x >= MOCK_OLED_WIDTH || y < 0 || y >= MOCK_OLED_TILES_Y * 8) return;
+    uint8_t& b = buffer[(y / 8) * MOCK_OLED_WIDTH + x];
+    b = color ? (uint8_t)(b | bits) : (uint8_t)(b & ~bits);
+  }
+
+  void transfer(uint32_t bytes) {
+    bytesSent += bytes;
+    transfers++;
+    MockClock::advanceUs((uint64_t)bytes * 8 * 1000000UL / MOCK_SPI_HZ);
+  }
+};
+
+class U8G2_SSD1306_128X64_NONAME_F_4W_HW_SPI : public U8G2 {
+public:
+  U8G2_SSD1306_128X64_NONAME_F_4W_HW_SPI(int rotation, int cs, int dc, int reset) {
+    (void)rotation; (void)cs; (void)dc; (void)reset;
+  }
+};
+
+#endif // MOCK_U8G2LIB_H
@@ -0,0 +1,36 @@
+/*
+ * DHT22 (native mock) - Synthesizes the sensor's reply for dht22_frame.h
+ *
+ * Feeds Dht22Capture the falling-edge timestamps the edge interrupt would
+ * see for a reading: the response pulse, then 40 bits of ~77 us (0) or
+ * ~120 us (1). Pass corrupt = true to flip a bit and break the checksum.
+ */
+
+#ifndef MOCK_DHT22_H
+#define MOCK_DHT22_H
+
+#include <stdint.h>
+#include "dht22_frame.h"
+
+inline void mockDht22Capture(Dht22Capture& capture, int16_t tempTenths, uint16_t humidityTenths,
+                             bool corrupt = false) {
+  uint16_t t = tempTenths < 0 ? (uint16_t)(0x8000 | -tempTenths) : (uint16_t)tempTenths;
+  uint8_t bytes[5] = {
+    (uint8_t)(humidityTenths >> 8), (uint8_t)humidityTenths, (uint8_t)(t >> 8), (uint8_t)t, 0
+  };
+  bytes[4] = (uint8_t)(bytes[0] + bytes[1] + bytes[2] + bytes[3]);
+  if (corrupt) bytes[1] ^= 0x01;
+
+  capture.reset();
+  uint32_t now = 1000;
+  capture.edge(now);          // Host releases the line
+  now += 160;
+  capture.edge(now);          // Sensor response
+  for (uint8_t i = 0; i < DHT22_FRAME_BITS; i++) {
+    bool one = bytes[i / 8] & (0x80 >> (i % 8));
+    now += one ? 120 : 77;
+    capture.edge(now);
+  }
+}
+
+#endif // MOCK_DHT22_H
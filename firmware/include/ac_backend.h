@@ -0,0 +1,137 @@
+/*
+ * AC Backend - Compile-time IR protocol selection for the ESP8266 hub
+ *
+ * Pick the protocol with a build flag in platformio.ini:
+ *   build_flags = -D AC_PROTOCOL=AC_PROTOCOL_MITSUBISHI
+ *
+ * Each AcTraits<> specialization names the IRremoteESP8266 class, its state
+ * length, how to drive swing, and the protocol-specific raw send. Only the
+ * selected protocol's header is included and every call resolves statically,
+ * so there is no per-send dispatch and the other protocols never reach flash.
+ *
+ * Mode and fan codes go through the library's own convertMode()/convertFan()
+ * via the common stdAc enums.
+ *
+ * To add a protocol: define AC_PROTOCOL_<NAME>, add a specialization below
+ * providing Ac, kStateLength, setSwing() and sendRaw(), and make sure
+ * replaying getRaw() bytes is valid for it (not true for protocols that send
+ * separate power-toggle messages, e.g. Samsung).
+ */
+
+#ifndef AC_BACKEND_H
+#define AC_BACKEND_H
+
+#include <IRremoteESP8266.h>
+#include <IRsend.h>
+#include "hvac_settings.h"
+
+#define AC_PROTOCOL_DAIKIN      1
+#define AC_PROTOCOL_MITSUBISHI  2
+#define AC_PROTOCOL_GREE        3
+
+#ifndef AC_PROTOCOL
+#define AC_PROTOCOL AC_PROTOCOL_DAIKIN
+#endif
+
+// HvacMode / HvacFan -> IRremoteESP8266's protocol-neutral enums
+inline stdAc::opmode_t acStdMode(uint8_t mode) {
+  switch (mode) {
+    case MODE_HEAT: return stdAc::opmode_t::kHeat;
+    case MODE_FAN: return stdAc::opmode_t::kFan;
+    case MODE_DRY: return stdAc::opmode_t::kDry;
+    case MODE_AUTO: return stdAc::opmode_t::kAuto;
+    default: return stdAc::opmode_t::kCool;
+  }
+}
+
+inline stdAc::fanspeed_t acStdFan(uint8_t fan) {
+  switch (fan) {
+    case FAN_LOW: return stdAc::fanspeed_t::kMin;
+    case FAN_MEDIUM: return stdAc::fanspeed_t::kMedium;
+    case FAN_HIGH: return stdAc::fanspeed_t::kMax;
+    default: return stdAc::fanspeed_t::kAuto;
+  }
+}
+
+template <uint8_t Protocol>
+struct AcTraits;
+
+#if AC_PROTOCOL == AC_PROTOCOL_DAIKIN
+#include <ir_Daikin.h>
+
+template <>
+struct AcTraits<AC_PROTOCOL_DAIKIN> {
+  typedef IRDaikinESP Ac;
+  static constexpr uint16_t kStateLength = kDaikinStateLength;
+  static constexpr const char* kName = "daikin";
+
+  static void setSwing(Ac& ac, bool on) {
+    ac.setSwingVertical(on);
+  }
+
+  static void sendRaw(IRsend& irsend, const uint8_t* state) {
+    irsend.sendDaikin(state, kStateLength);
+  }
+};
+
+#elif AC_PROTOCOL == AC_PROTOCOL_MITSUBISHI
+#include <ir_Mitsubishi.h>
+
+template <>
+struct AcTraits<AC_PROTOCOL_MITSUBISHI> {
+  typedef IRMitsubishiAC Ac;
+  static constexpr uint16_t kStateLength = kMitsubishiACStateLength;
+  static constexpr const char* kName = "mitsubishi";
+
+  static void setSwing(Ac& ac, bool on) {
+    ac.setVane(on ? kMitsubishiAcVaneAutoMove : kMitsubishiAcVaneAuto);
+  }
+
+  static void sendRaw(IRsend& irsend, const uint8_t* state) {
+    irsend.sendMitsubishiAC(state, kStateLength);
+  }
+};
+
+#elif AC_PROTOCOL == AC_PROTOCOL_GREE
+#include <ir_Gree.h>
+
+template <>
+struct AcTraits<AC_PROTOCOL_GREE> {
+  typedef IRGreeAC Ac;
+  static constexpr uint16_t kStateLength = kGreeStateLength;
+  static constexpr const char* kName = "gree";
+
+  static void setSwing(Ac& ac, bool on) {
+    if (on) {
+      ac.setSwingVertical(true, kGreeSwingAuto);
+    } else {
+      ac.setSwingVertical(false, kGreeSwingLastPos);
+    }
+  }
+
+  static void sendRaw(IRsend& irsend, const uint8_t* state) {
+    irsend.sendGree(state, kStateLength);
+  }
+};
+
+#else
+#error "Unknown AC_PROTOCOL; see ac_backend.h"
+#endif
+
+typedef AcTraits<AC_PROTOCOL> AcBackend;
+
+// Loads settings into the backend's state; read the encoded bytes with getRaw()
+template <typename Traits>
+inline void acApply(typename Traits::Ac& ac, const HVACSettings& s) {
+  if (s.power) {
+    ac.on();
+  } else {
+    ac.off();
+  }
+  ac.setTemp(s.setTemp);
+  ac.setMode(Traits::Ac::convertMode(acStdMode(s.mode)));
+  ac.setFan(Traits::Ac::convertFan(acStdFan(s.fanSpeed)));
+  Traits::setSwing(ac, s.swing);
+}
+
+#endif // AC_BACKEND_H
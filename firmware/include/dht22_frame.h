@@ -0,0 +1,84 @@
+/*
+ * DHT22 Frame Capture - Interrupt-driven decoding of the DHT22 one-wire frame
+ *
+ * The Adafruit driver bit-bangs the 40-bit frame with interrupts disabled for
+ * about 5 ms. Instead, the R4 starts a reading, lets a falling-edge interrupt
+ * timestamp the line, and decodes the captured intervals later from loop().
+ *
+ * Wire timing after the host releases the start pulse:
+ *   sensor response  80 us low + 80 us high
+ *   each bit         50 us low + ~27 us high (0) or ~70 us high (1)
+ *   end of frame     50 us low, then released
+ *
+ * Measured falling edge to falling edge, the response is ~160 us, a 0 bit
+ * ~77 us and a 1 bit ~120 us. The 40 bits are always the last 40 intervals,
+ * so a missed response edge doesn't shift the frame.
+ *
+ * Frame: humidity (u16, tenths %RH), temperature (tenths C, bit 15 = sign),
+ *        checksum (low byte of the sum of the first four bytes).
+ */
+
+#ifndef DHT22_FRAME_H
+#define DHT22_FRAME_H
+
+#include <stdint.h>
+
+#define DHT22_FRAME_BITS     40
+#define DHT22_MAX_INTERVALS  (DHT22_FRAME_BITS + 1)  // Response + 40 bits
+#define DHT22_BIT_THRESHOLD  100                     // us; longer intervals are 1 bits
+
+struct Dht22Reading {
+  int16_t temp;       // tenths of degrees C
+  uint16_t humidity;  // tenths of percent RH
+};
+
+struct Dht22Capture {
+  volatile uint8_t intervals[DHT22_MAX_INTERVALS];  // us, clamped to 255
+  volatile uint8_t count = 0;
+  volatile bool seenEdge = false;
+  volatile uint32_t lastEdge = 0;
+
+  // Call with the edge interrupt detached
+  void reset() {
+    count = 0;
+    seenEdge = false;
+  }
+
+  // Called from the falling-edge ISR with the current micros()
+  void edge(uint32_t now) {
+    if (seenEdge && count < DHT22_MAX_INTERVALS) {
+      uint32_t interval = now - lastEdge;
+      intervals[count] = interval > 255 ? 255 : (uint8_t)interval;
+      count = count + 1;
+    }
+    lastEdge = now;
+    seenEdge = true;
+  }
+
+  bool complete() const {
+    return count >= DHT22_MAX_INTERVALS;
+  }
+
+  // Returns false if fewer than 40 bits were captured or the checksum fails
+  bool decode(Dht22Reading& out) const {
+    uint8_t n = count;
+    if (n < DHT22_FRAME_BITS) return false;
+
+    uint8_t bytes[5] = { 0, 0, 0, 0, 0 };
+    uint8_t first = n - DHT22_FRAME_BITS;
+    for (uint8_t i = 0; i < DHT22_FRAME_BITS; i++) {
+      bytes[i / 8] <<= 1;
+      if (intervals[first + i] > DHT22_BIT_THRESHOLD) bytes[i / 8] |= 1;
+    }
+
+    uint8_t sum = (uint8_t)(bytes[0] + bytes[1] + bytes[2] + bytes[3]);
+    if (sum != bytes[4]) return false;
+
+    out.humidity = (uint16_t)((bytes[0] << 8) | bytes[1]);
+    int16_t temp = (int16_t)(((bytes[2] & 0x7F) << 8) | bytes[3]);
+    out.temp = (bytes[2] & 0x80) ? (int16_t)-temp : temp;
+    return true;
+  }
+};
+
+#endif // DHT22_FRAME_H
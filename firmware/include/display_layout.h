@@ -0,0 +1,80 @@
+/*
+ * Display Layout - Compile-time geometry and cached text for the R4's OLEDs
+ *
+ * The three fonts are monospaced, so a string's width is its length times
+ * the font's advance: centered positions for fixed text (window titles,
+ * screen titles) are worked out by the compiler and need no getStrWidth()
+ * at run time.
+ *
+ * Values shown on screen go through CachedText, which reformats only when
+ * the value it was built from changes and keeps the centered x with it. A
+ * redraw then only copies pixels; no sprintf or float formatting per frame.
+ */
+
+#ifndef DISPLAY_LAYOUT_H
+#define DISPLAY_LAYOUT_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Glyph advance of each font, in pixels
+#define FONT_SMALL_WIDTH   5   // u8g2_font_5x7_tr: window titles
+#define FONT_MEDIUM_WIDTH  6   // u8g2_font_6x10_tr: labels and window values
+#define FONT_LARGE_WIDTH  10   // u8g2_font_10x20_tr: room readings
+
+// Baselines within a settings window, from its top edge
+#define WINDOW_TITLE_Y   9
+#define WINDOW_VALUE_Y  20
+
+constexpr uint8_t textLength(const char* s) {
+  return *s ? (uint8_t)(1 + textLength(s + 1)) : 0;
+}
+
+// Left edge that centers len characters in [x, x + w)
+constexpr int16_t centerText(int16_t x, int16_t w, uint8_t len, uint8_t charWidth) {
+  return (int16_t)(x + (w - len * charWidth) / 2);
+}
+
+struct WindowLayout {
+  int16_t x, y, w, h;
+  const char* title;
+  int16_t titleX;   // Centered, in FONT_SMALL_WIDTH
+};
+
+constexpr WindowLayout makeWindow(int16_t x, int16_t y, int16_t w, int16_t h, const char* title) {
+  return { x, y, w, h, title, centerText(x, w, textLength(title), FONT_SMALL_WIDTH) };
+}
+
+// A value's text, formatted only when the value changes
+template <uint8_t N>
+struct CachedText {
+  char text[N] = "";
+  int16_t x = 0;        // Left edge as last placed
+  int32_t key = 0;
+  bool valid = false;
+
+  // True (and the new key stored) when key differs from the cached text's;
+  // the caller then formats and calls set()
+  bool changed(int32_t newKey) {
+    if (valid && newKey == key) return false;
+    key = newKey;
+    valid = true;
+    return true;
+  }
+
+  // Copies s, centered in [boxX, boxX + boxW)
+  void set(const char* s, int16_t boxX, int16_t boxW, uint8_t charWidth) {
+    size_t len = strlen(s);
+    if (len >= N) len = N - 1;
+    memcpy(text, s, len);
+    text[len] = '\0';
+    x = centerText(boxX, boxW, (uint8_t)len, charWidth);
+  }
+
+  // Copies s with its left edge at x
+  void set(const char* s, int16_t left) {
+    set(s, left, 0, 0);
+  }
+};
+
+#endif // DISPLAY_LAYOUT_H
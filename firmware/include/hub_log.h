@@ -0,0 +1,251 @@
+/*
+ * Hub Log - Levelled, rate-limited logging with a binary ring buffer
+ *
+ * On the ESP8266, Serial is the data link to the R4, so log text has to go
+ * somewhere else. LOG_ERROR / LOG_WARN / LOG_INFO / LOG_DEBUG take a printf
+ * format (a string literal) and arguments, and:
+ *
+ * - compile to nothing above LOG_LEVEL; LOG_LEVEL_NONE removes logging,
+ *   ring included, and the arguments are never evaluated
+ * - append a record to logRing: time, level, the format's address and the
+ *   first two numeric arguments among the first four. Formatting waits
+ *   until the ring is dumped (LogRing::format()), so recording is a few
+ *   stores. Strings aren't kept and dump as "?"; floats keep two decimals.
+ * - write the formatted line to the target's sink through logText(), which
+ *   is rate limited with LogLimiter so a burst can't stall loop() on a slow
+ *   UART. The ring keeps what the limiter drops.
+ *
+ * Each target that logs defines logClock(), logText() and logRing.
+ */
+
+#ifndef HUB_LOG_H
+#define HUB_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <type_traits>
+
+#define LOG_LEVEL_NONE   0
+#define LOG_LEVEL_ERROR  1
+#define LOG_LEVEL_WARN   2
+#define LOG_LEVEL_INFO   3
+#define LOG_LEVEL_DEBUG  4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL  LOG_LEVEL_INFO
+#endif
+
+#define LOG_RING_SIZE   64   // Records, 20 bytes each
+#define LOG_RATE        10   // Lines per second to the sink...
+#define LOG_BURST       30   // ...after a burst of this many
+
+enum LogArgType : uint8_t {
+  LOG_ARG_NONE = 0,   // Not kept (strings, pointers, or no room left)
+  LOG_ARG_INT,
+  LOG_ARG_UINT,
+  LOG_ARG_CENTI       // Float, in hundredths
+};
+
+struct LogRecord {
+  uint32_t ms;
+  const char* fmt;
+  int32_t args[2];    // Numeric arguments, in order
+  uint8_t level;
+  uint8_t types;      // LogArgType of each of the first 4 arguments, 2 bits each
+};
+
+#define LOG_KEPT_ARGS  4
+
+inline char logLevelChar(uint8_t level) {
+  static const char names[] = "-EWID";
+  return level <= LOG_LEVEL_DEBUG ? names[level] : '?';
+}
+
+// ----------------------------------------------------------------------------
+// Argument capture
+// ----------------------------------------------------------------------------
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, uint8_t>::type
+logCapture(T v, int32_t& out) {
+  out = (int32_t)v;
+  return std::is_signed<T>::value ? LOG_ARG_INT : LOG_ARG_UINT;
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_floating_point<T>::value, uint8_t>::type
+logCapture(T v, int32_t& out) {
+  out = (int32_t)(v * 100 + (v >= 0 ? 0.5f : -0.5f));
+  return LOG_ARG_CENTI;
+}
+
+template <typename T>
+inline typename std::enable_if<!std::is_arithmetic<T>::value && !std::is_enum<T>::value, uint8_t>::type
+logCapture(const T&, int32_t& out) {
+  out = 0;
+  return LOG_ARG_NONE;
+}
+
+inline void logCaptureArgs(LogRecord&, uint8_t, uint8_t) {}
+
+// i: argument position, kept: numeric values stored so far
+template <typename T, typename... Rest>
+inline void logCaptureArgs(LogRecord& r, uint8_t i, uint8_t kept, const T& v, const Rest&... rest) {
+  if (i >= LOG_KEPT_ARGS || kept >= 2) return;
+  uint8_t type = logCapture(v, r.args[kept]);
+  r.types |= (uint8_t)(type << (i * 2));
+  logCaptureArgs(r, (uint8_t)(i + 1), (uint8_t)(kept + (type != LOG_ARG_NONE)), rest...);
+}
+
+// ----------------------------------------------------------------------------
+// Ring
+// ----------------------------------------------------------------------------
+
+struct LogRing {
+  LogRecord records[LOG_RING_SIZE];
+  uint32_t total = 0;   // Records since boot; the ring holds the last LOG_RING_SIZE
+
+  template <typename... Args>
+  void add(uint32_t ms, uint8_t level, const char* fmt, const Args&... args) {
+    LogRecord& r = records[total % LOG_RING_SIZE];
+    r.ms = ms;
+    r.fmt = fmt;
+    r.level = level;
+    r.types = 0;
+    r.args[0] = r.args[1] = 0;
+    logCaptureArgs(r, 0, 0, args...);
+    total++;
+  }
+
+  uint16_t count() const {
+    return total < LOG_RING_SIZE ? (uint16_t)total : (uint16_t)LOG_RING_SIZE;
+  }
+
+  // i-th oldest record still in the ring
+  const LogRecord& at(uint16_t i) const {
+    return records[(total - count() + i) % LOG_RING_SIZE];
+  }
+
+  void clear() {
+    total = 0;
+  }
+
+  // "[seconds.ms] L text", with the kept arguments in place of the
+  // conversions; widths and precisions are ignored
+  static int format(const LogRecord& r, char* out, size_t size) {
+    if (size == 0) return 0;
+    size_t n = (size_t)snprintf(out, size, "[%6lu.%03lu] %c ", (unsigned long)(r.ms / 1000),
+                                (unsigned long)(r.ms % 1000), logLevelChar(r.level));
+    uint8_t arg = 0;
+    uint8_t kept = 0;
+    for (const char* p = r.fmt; *p && n + 1 < size; p++) {
+      if (*p != '%') {
+        out[n++] = *p;
+        continue;
+      }
+      if (p[1] == '%') {
+        out[n++] = '%';
+        p++;
+        continue;
+      }
+      // Skip flags, width, precision and length up to the conversion
+      while (p[1] && strchr("-+ #0123456789.lhz", p[1])) p++;
+      char conv = p[1];
+      if (conv == '\0') break;
+      p++;
+
+      uint8_t type = arg < LOG_KEPT_ARGS ? (uint8_t)((r.types >> (arg * 2)) & 0x03)
+                                         : (uint8_t)LOG_ARG_NONE;
+      int32_t v = type != LOG_ARG_NONE ? r.args[kept++] : 0;
+      arg++;
+      int w;
+      if (type == LOG_ARG_NONE || conv == 's' || conv == 'p') {
+        w = snprintf(out + n, size - n, "?");
+      } else if (type == LOG_ARG_CENTI) {
+        int32_t a = v < 0 ? -v : v;
+        w = snprintf(out + n, size - n, "%s%ld.%02ld", v < 0 ? "-" : "", (long)(a / 100),
+                     (long)(a % 100));
+      } else if (conv == 'c') {
+        w = snprintf(out + n, size - n, "%c", (char)v);
+      } else if (conv == 'x' || conv == 'X') {
+        w = snprintf(out + n, size - n, "%lx", (unsigned long)(uint32_t)v);
+      } else if (type == LOG_ARG_UINT || conv == 'u') {
+        w = snprintf(out + n, size - n, "%lu", (unsigned long)(uint32_t)v);
+      } else {
+        w = snprintf(out + n, size - n, "%ld", (long)v);
+      }
+      if (w < 0) break;
+      n += (size_t)w;
+      if (n >= size) n = size - 1;
+    }
+    out[n] = '\0';
+    return (int)n;
+  }
+};
+
+// ----------------------------------------------------------------------------
+// Rate limit for the text sink
+// ----------------------------------------------------------------------------
+
+struct LogLimiter {
+  uint32_t milliTokens = LOG_BURST * 1000UL;
+  uint32_t last = 0;
+  uint32_t dropped = 0;   // Lines not written since the last one that was
+
+  bool allow(uint32_t now) {
+    uint32_t elapsed = now - last;
+    last = now;
+    if (elapsed > LOG_BURST * 1000UL) elapsed = LOG_BURST * 1000UL;   // Refill caps anyway
+    milliTokens += elapsed * LOG_RATE;
+    if (milliTokens > LOG_BURST * 1000UL) milliTokens = LOG_BURST * 1000UL;
+    if (milliTokens < 1000) {
+      dropped++;
+      return false;
+    }
+    milliTokens -= 1000;
+    return true;
+  }
+};
+
+// ----------------------------------------------------------------------------
+// Macros
+// ----------------------------------------------------------------------------
+
+uint32_t logClock();
+void logText(uint8_t level, const char* fmt, ...);
+extern LogRing logRing;
+
+// By value: arguments may be constexpr members with no out-of-line definition
+template <typename... Args>
+inline void logWrite(uint8_t level, const char* fmt, Args... args) {
+  logRing.add(logClock(), level, fmt, args...);
+  logText(level, fmt, args...);
+}
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...)  logWrite(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...)  do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...)   logWrite(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...)   do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...)   logWrite(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...)   do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...)  logWrite(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...)  do {} while (0)
+#endif
+
+#endif // HUB_LOG_H
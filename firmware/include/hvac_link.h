@@ -0,0 +1,291 @@
+/*
+ * HVAC Link Protocol - Compact binary framing for the R4 <-> ESP8266 UART
+ *
+ * Shared by both firmware targets. Keep this header free of Arduino types so
+ * it can be reused by any build that only needs the frame format.
+ *
+ * Frame layout (multi-byte fields are little-endian):
+ *   [0]      sync    LINK_SYNC (0xA5)
+ *   [1]      len     payload length in bytes (0..LINK_MAX_PAYLOAD)
+ *   [2]      type    LinkMsgType
+ *   [3..]    payload
+ *   [last 2] crc     CRC-16/CCITT-FALSE over len, type and payload
+ *
+ * Negotiation:
+ * - Every node still understands newline-terminated JSON.
+ * - On boot a node announces itself with a HELLO frame.
+ * - A node transmits frames only after it has heard a valid frame from its
+ *   peer, and falls back to JSON as soon as its peer sends a JSON line.
+ *   An old JSON-only peer simply ignores the HELLO, so the link keeps working.
+ *
+ * Delta sync:
+ * - STATE/SETTINGS are keyframes carrying every field plus a sequence number.
+ * - DELTA carries the sequence number, a field mask and only the changed fields.
+ * - A receiver that sees a sequence gap sends SYNC_REQ; the peer answers with
+ *   a keyframe. Keyframes are also sent periodically for resync.
+ */
+
+#ifndef HVAC_LINK_H
+#define HVAC_LINK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "hvac_settings.h"
+
+#define LINK_SYNC            0xA5
+#define LINK_VERSION         2
+#define LINK_HEADER_SIZE     3   // sync + len + type
+#define LINK_CRC_SIZE        2
+#define LINK_MAX_PAYLOAD     32
+#define LINK_MAX_FRAME       (LINK_HEADER_SIZE + LINK_MAX_PAYLOAD + LINK_CRC_SIZE)
+
+enum LinkMsgType : uint8_t {
+  LINK_MSG_HELLO    = 0x01,  // payload: version
+  LINK_MSG_STATE    = 0x10,  // payload: LinkConditions + settings + seq (R4 -> ESP)
+  LINK_MSG_SETTINGS = 0x11,  // payload: settings + seq (ESP -> R4)
+  LINK_MSG_DELTA    = 0x12,  // payload: seq, mask, changed fields (either direction)
+  LINK_MSG_SYNC_REQ = 0x13,  // no payload: ask the peer for a keyframe
+  LINK_MSG_ACK      = 0x14,  // payload: seq of the last ESP message now on screen (R4 -> ESP)
+  LINK_MSG_MEM      = 0x15,  // payload: heap and stack stats, see mem_stats.h (R4 -> ESP)
+  LINK_MSG_BAUD     = 0x16,  // payload: op, rate index, see link_baud.h (either direction)
+  LINK_MSG_PROBE    = 0x17   // payload: rate test pattern, echoed back by the R4
+};
+
+// Settings flags byte: bit0 power, bit1 swing, bits2-4 mode, bits5-7 fan
+#define LINK_FLAG_POWER  0x01
+#define LINK_FLAG_SWING  0x02
+
+struct LinkConditions {
+  int16_t temp;      // centi-degrees C
+  uint16_t humidity; // centi-percent RH
+};
+
+#define LINK_SETTINGS_SIZE    4
+#define LINK_CONDITIONS_SIZE  4
+
+// Delta mask: FIELD_* bits from hvac_settings.h plus room conditions
+#define LINK_DELTA_CONDITIONS 0x40
+#define LINK_DELTA_FLAGS      (FIELD_POWER | FIELD_SWING | FIELD_MODE | FIELD_FAN)
+
+// ----------------------------------------------------------------------------
+// Field helpers
+// ----------------------------------------------------------------------------
+
+inline void linkPutU16(uint8_t* p, uint16_t v) {
+  p[0] = (uint8_t)(v & 0xFF);
+  p[1] = (uint8_t)(v >> 8);
+}
+
+inline uint16_t linkGetU16(const uint8_t* p) {
+  return (uint16_t)(p[0] | ((uint16_t)p[1] << 8));
+}
+
+inline uint8_t linkPackFlags(const HVACSettings& s) {
+  return (s.power ? LINK_FLAG_POWER : 0) | (s.swing ? LINK_FLAG_SWING : 0) |
+         ((s.mode & 0x07) << 2) | ((s.fanSpeed & 0x07) << 5);
+}
+
+inline void linkUnpackFlags(uint8_t flags, HVACSettings& s) {
+  uint8_t mode = (flags >> 2) & 0x07;
+  uint8_t fan = (flags >> 5) & 0x07;
+  s.power = (flags & LINK_FLAG_POWER) ? 1 : 0;
+  s.swing = (flags & LINK_FLAG_SWING) ? 1 : 0;
+  s.mode = mode < MODE_COUNT ? mode : (uint8_t)MODE_COOL;
+  s.fanSpeed = fan < FAN_COUNT ? fan : (uint8_t)FAN_AUTO;
+}
+
+// Settings payload: flags, setTemp (degrees C), timer (minutes, u16)
+inline void linkPutSettings(uint8_t* p, const HVACSettings& s) {
+  p[0] = linkPackFlags(s);
+  p[1] = s.setTemp;
+  linkPutU16(p + 2, s.timer);
+}
+
+inline void linkGetSettings(const uint8_t* p, HVACSettings& s) {
+  linkUnpackFlags(p[0], s);
+  s.setTemp = clampSetTemp(p[1]);
+  s.timer = clampTimer(linkGetU16(p + 2));
+}
+
+inline void linkPutConditions(uint8_t* p, const LinkConditions& c) {
+  linkPutU16(p, (uint16_t)c.temp);
+  linkPutU16(p + 2, c.humidity);
+}
+
+inline void linkGetConditions(const uint8_t* p, LinkConditions& c) {
+  c.temp = (int16_t)linkGetU16(p);
+  c.humidity = linkGetU16(p + 2);
+}
+
+// Delta payload: seq, mask, then only the fields selected by mask, in order:
+//   flags (if any LINK_DELTA_FLAGS bit), setTemp, timer (u16), conditions (4)
+// Returns the payload size (at most 10 bytes).
+inline uint8_t linkPutDelta(uint8_t* p, uint8_t seq, uint8_t mask,
+                            const HVACSettings& s, const LinkConditions& c) {
+  uint8_t n = 0;
+  p[n++] = seq;
+  p[n++] = mask;
+  if (mask & LINK_DELTA_FLAGS) p[n++] = linkPackFlags(s);
+  if (mask & FIELD_SET_TEMP) p[n++] = s.setTemp;
+  if (mask & FIELD_TIMER) {
+    linkPutU16(p + n, s.timer);
+    n += 2;
+  }
+  if (mask & LINK_DELTA_CONDITIONS) {
+    linkPutConditions(p + n, c);
+    n += LINK_CONDITIONS_SIZE;
+  }
+  return n;
+}
+
+// Decodes a delta into s and c, touching only the fields selected by mask.
+// Returns false if the payload is shorter than its mask says.
+inline bool linkGetDelta(const uint8_t* p, uint8_t len, uint8_t& seq, uint8_t& mask,
+                         HVACSettings& s, LinkConditions& c) {
+  if (len < 2) return false;
+  seq = p[0];
+  mask = p[1];
+  uint8_t n = 2;
+
+  if (mask & LINK_DELTA_FLAGS) {
+    if (n + 1 > len) return false;
+    HVACSettings flags;
+    linkUnpackFlags(p[n++], flags);
+    applySettingsFields(s, flags, mask & LINK_DELTA_FLAGS);
+  }
+  if (mask & FIELD_SET_TEMP) {
+    if (n + 1 > len) return false;
+    s.setTemp = clampSetTemp(p[n++]);
+  }
+  if (mask & FIELD_TIMER) {
+    if (n + 2 > len) return false;
+    s.timer = clampTimer(linkGetU16(p + n));
+    n += 2;
+  }
+  if (mask & LINK_DELTA_CONDITIONS) {
+    if (n + LINK_CONDITIONS_SIZE > len) return false;
+    linkGetConditions(p + n, c);
+  }
+  return true;
+}
+
+// Tracks the peer's sequence numbers to detect lost deltas
+struct LinkSeqTracker {
+  uint8_t expected = 0;
+  bool synced = false;   // Seen a keyframe since boot
+  uint16_t gaps = 0;
+
+  void keyframe(uint8_t seq) {
+    expected = (uint8_t)(seq + 1);
+    synced = true;
+  }
+
+  // Returns false if the delta doesn't follow on from the previous message
+  bool delta(uint8_t seq) {
+    bool inOrder = synced && seq == expected;
+    expected = (uint8_t)(seq + 1);
+    if (!inOrder) gaps++;
+    return inOrder;
+  }
+};
+
+// ----------------------------------------------------------------------------
+// Framing
+// ----------------------------------------------------------------------------
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF), bitwise to avoid a 512 B table
+inline uint16_t linkCrc16(const uint8_t* data, size_t len, uint16_t crc = 0xFFFF) {
+  while (len--) {
+    crc ^= (uint16_t)(*data++) << 8;
+    for (uint8_t i = 0; i < 8; i++) {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+// Builds a complete frame into out (at least LINK_MAX_FRAME bytes).
+// Returns the frame size, or 0 if the payload is too large.
+inline size_t linkEncodeFrame(uint8_t type, const uint8_t* payload, uint8_t len, uint8_t* out) {
+  if (len > LINK_MAX_PAYLOAD) return 0;
+  out[0] = LINK_SYNC;
+  out[1] = len;
+  out[2] = type;
+  if (len > 0) memcpy(out + LINK_HEADER_SIZE, payload, len);
+  uint16_t crc = linkCrc16(out + 1, len + 2);
+  linkPutU16(out + LINK_HEADER_SIZE + len, crc);
+  return LINK_HEADER_SIZE + len + LINK_CRC_SIZE;
+}
+
+// Incremental frame decoder. Feed bytes one at a time; push() returns true
+// when a complete, CRC-valid frame is available in type/len/payload.
+struct LinkFrameParser {
+  enum State : uint8_t { WAIT_SYNC, READ_LEN, READ_TYPE, READ_PAYLOAD, READ_CRC };
+
+  State state = WAIT_SYNC;
+  uint8_t type = 0;
+  uint8_t len = 0;
+  uint8_t payload[LINK_MAX_PAYLOAD];
+  uint8_t index = 0;
+  uint8_t crcBytes[LINK_CRC_SIZE];
+  uint16_t crcErrors = 0;
+
+  void reset() {
+    state = WAIT_SYNC;
+    index = 0;
+  }
+
+  bool busy() const {
+    return state != WAIT_SYNC;
+  }
+
+  bool push(uint8_t b) {
+    switch (state) {
+      case WAIT_SYNC:
+        if (b == LINK_SYNC) state = READ_LEN;
+        return false;
+
+      case READ_LEN:
+        if (b > LINK_MAX_PAYLOAD) {
+          reset();
+          return false;
+        }
+        len = b;
+        state = READ_TYPE;
+        return false;
+
+      case READ_TYPE:
+        type = b;
+        index = 0;
+        state = (len > 0) ? READ_PAYLOAD : READ_CRC;
+        return false;
+
+      case READ_PAYLOAD:
+        payload[index++] = b;
+        if (index >= len) {
+          index = 0;
+          state = READ_CRC;
+        }
+        return false;
+
+      case READ_CRC: {
+        crcBytes[index++] = b;
+        if (index < LINK_CRC_SIZE) return false;
+
+        uint8_t header[2] = { len, type };
+        uint16_t crc = linkCrc16(header, 2);
+        crc = linkCrc16(payload, len, crc);
+        reset();
+        if (crc != linkGetU16(crcBytes)) {
+          crcErrors++;
+          return false;
+        }
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+#endif // HVAC_LINK_H
@@ -0,0 +1,132 @@
+/*
+ * HVAC Schedule - Weekly schedule slots evaluated on the ESP8266 hub
+ *
+ * A slot fires at a local time of day on the weekdays in its mask and sets
+ * power and/or the setpoint. The hub fetches the slots once from the server
+ * (GET /api/schedule/slots, again whenever the advertised version changes),
+ * keeps local time with SNTP and arms a timer for the next edge, so edges
+ * fire on time even while the server is unreachable.
+ *
+ * Times are seconds into the week from Sunday 00:00 (struct tm's tm_wday).
+ * Slots with the same time apply in list order.
+ */
+
+#ifndef HVAC_SCHEDULE_H
+#define HVAC_SCHEDULE_H
+
+#include <stdint.h>
+#include "hvac_settings.h"
+
+#define SCHEDULE_MAX_SLOTS     16
+#define SCHEDULE_DAY_SECONDS   86400UL
+#define SCHEDULE_WEEK_SECONDS  604800UL
+#define SCHEDULE_ALL_DAYS      0x7F
+
+enum SchedulePower : uint8_t {
+  SCHEDULE_POWER_OFF = 0,
+  SCHEDULE_POWER_ON = 1,
+  SCHEDULE_POWER_KEEP = 2   // Setpoint-only slot
+};
+
+struct ScheduleSlot {
+  uint8_t days;      // Bit 0 = Sunday ... bit 6 = Saturday
+  uint16_t minute;   // Minute of the day, 0-1439
+  uint8_t power;     // SchedulePower
+  uint8_t setTemp;   // °C, 0 = leave unchanged
+};
+
+// Seconds into the week for a local time
+inline uint32_t scheduleWeekSecond(uint8_t wday, uint8_t hour, uint8_t minute, uint8_t second) {
+  return wday * SCHEDULE_DAY_SECONDS + hour * 3600UL + minute * 60UL + second;
+}
+
+struct HvacSchedule {
+  uint32_t version = 0;
+  bool enabled = false;
+  uint8_t count = 0;
+  ScheduleSlot slots[SCHEDULE_MAX_SLOTS];
+
+  // Adds a slot; rejects malformed ones and returns false when full
+  bool add(uint8_t days, uint16_t minute, uint8_t power, uint8_t setTemp) {
+    days &= SCHEDULE_ALL_DAYS;
+    if (count >= SCHEDULE_MAX_SLOTS || days == 0 || minute >= 1440 ||
+        power > SCHEDULE_POWER_KEEP) {
+      return false;
+    }
+    if (setTemp != 0) setTemp = clampSetTemp(setTemp);
+    if (power == SCHEDULE_POWER_KEEP && setTemp == 0) return false;  // Does nothing
+
+    slots[count++] = {days, minute, power, setTemp};
+    return true;
+  }
+
+  // Seconds since the slot's last edge at or before weekSecond, in [0, week)
+  static uint32_t sinceEdge(const ScheduleSlot& slot, uint32_t weekSecond) {
+    uint32_t best = SCHEDULE_WEEK_SECONDS;
+    for (uint8_t d = 0; d < 7; d++) {
+      if (slot.days & (1 << d)) {
+        uint32_t edge = d * SCHEDULE_DAY_SECONDS + slot.minute * 60UL;
+        uint32_t since = (weekSecond + SCHEDULE_WEEK_SECONDS - edge) % SCHEDULE_WEEK_SECONDS;
+        if (since < best) best = since;
+      }
+    }
+    return best;
+  }
+
+  // Seconds until the slot's next edge after weekSecond, in (0, week]
+  static uint32_t untilEdge(const ScheduleSlot& slot, uint32_t weekSecond) {
+    uint32_t best = SCHEDULE_WEEK_SECONDS;
+    for (uint8_t d = 0; d < 7; d++) {
+      if (slot.days & (1 << d)) {
+        uint32_t edge = d * SCHEDULE_DAY_SECONDS + slot.minute * 60UL;
+        uint32_t until = (edge + SCHEDULE_WEEK_SECONDS - weekSecond) % SCHEDULE_WEEK_SECONDS;
+        if (until == 0) until = SCHEDULE_WEEK_SECONDS;
+        if (until < best) best = until;
+      }
+    }
+    return best;
+  }
+
+  // Seconds since the most recent edge of any slot
+  uint32_t sinceLast(uint32_t weekSecond) const {
+    uint32_t best = SCHEDULE_WEEK_SECONDS;
+    for (uint8_t i = 0; i < count; i++) {
+      uint32_t since = sinceEdge(slots[i], weekSecond);
+      if (since < best) best = since;
+    }
+    return best;
+  }
+
+  // Seconds until the next edge of any slot (a week when there are none)
+  uint32_t untilNext(uint32_t weekSecond) const {
+    uint32_t best = SCHEDULE_WEEK_SECONDS;
+    for (uint8_t i = 0; i < count; i++) {
+      uint32_t until = untilEdge(slots[i], weekSecond);
+      if (until < best) best = until;
+    }
+    return best;
+  }
+
+  // Applies every slot whose edge was the most recent one; returns the
+  // fields that changed
+  uint8_t applyLast(HVACSettings& s, uint32_t weekSecond) const {
+    uint32_t since = sinceLast(weekSecond);
+    uint8_t changed = 0;
+    for (uint8_t i = 0; i < count; i++) {
+      const ScheduleSlot& slot = slots[i];
+      if (sinceEdge(slot, weekSecond) != since) continue;
+
+      if (slot.power != SCHEDULE_POWER_KEEP && s.power != (slot.power == SCHEDULE_POWER_ON)) {
+        s.power = slot.power == SCHEDULE_POWER_ON;
+        changed |= FIELD_POWER;
+      }
+      if (slot.setTemp != 0 && s.setTemp != slot.setTemp) {
+        s.setTemp = slot.setTemp;
+        changed |= FIELD_SET_TEMP;
+      }
+    }
+    return changed;
+  }
+};
+
+#endif // HVAC_SCHEDULE_H
@@ -0,0 +1,197 @@
+/*
+ * HVAC Settings - Packed settings type shared by the R4 and ESP8266 builds
+ *
+ * The enumerated settings are stored as small integer codes instead of
+ * Arduino Strings, so comparing, copying and assigning settings never touches
+ * the heap. The whole struct fits in 4 bytes; use == / != to diff it.
+ *
+ * Names used on the wire (JSON link and server API) come from the constexpr
+ * tables below; lookups are bounds-checked and fall back to the defaults.
+ */
+
+#ifndef HVAC_SETTINGS_H
+#define HVAC_SETTINGS_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define HVAC_TEMP_MIN     16
+#define HVAC_TEMP_MAX     30
+#define HVAC_TIMER_MAX    720   // minutes
+
+enum HvacMode : uint8_t {
+  MODE_COOL = 0,
+  MODE_HEAT,
+  MODE_FAN,
+  MODE_DRY,
+  MODE_AUTO,
+  MODE_COUNT
+};
+
+enum HvacFan : uint8_t {
+  FAN_LOW = 0,
+  FAN_MEDIUM,
+  FAN_HIGH,
+  FAN_AUTO,
+  FAN_COUNT
+};
+
+// Where the most recent settings change came from
+enum HvacSource : uint8_t {
+  SOURCE_ARDUINO = 0,
+  SOURCE_WEB,
+  SOURCE_SCHEDULE,
+  SOURCE_SYNCED,
+  SOURCE_COUNT
+};
+
+constexpr const char* kModeNames[MODE_COUNT] = { "cool", "heat", "fan", "dry", "auto" };
+constexpr const char* kFanNames[FAN_COUNT] = { "low", "medium", "high", "auto" };
+constexpr const char* kFanLabels[FAN_COUNT] = { "LOW", "MED", "HIGH", "AUTO" };
+constexpr const char* kOnOffNames[2] = { "off", "on" };
+constexpr const char* kOnOffLabels[2] = { "OFF", "ON" };
+constexpr const char* kSourceNames[SOURCE_COUNT] = { "arduino", "web", "schedule", "synced" };
+
+struct HVACSettings {
+  uint8_t power : 1;      // 1 = on
+  uint8_t swing : 1;      // 1 = on
+  uint8_t mode : 3;       // HvacMode
+  uint8_t fanSpeed : 3;   // HvacFan
+  uint8_t setTemp;        // degrees C
+  uint16_t timer;         // minutes, 0 = off
+
+  HVACSettings()
+    : power(1), swing(1), mode(MODE_COOL), fanSpeed(FAN_MEDIUM), setTemp(24), timer(0) {}
+
+  bool operator==(const HVACSettings& other) const {
+    return power == other.power && swing == other.swing && mode == other.mode &&
+           fanSpeed == other.fanSpeed && setTemp == other.setTemp && timer == other.timer;
+  }
+
+  bool operator!=(const HVACSettings& other) const {
+    return !(*this == other);
+  }
+};
+
+static_assert(sizeof(HVACSettings) == 4, "HVACSettings should pack into one 32-bit word");
+
+// ----------------------------------------------------------------------------
+// Per-field dirty tracking
+// ----------------------------------------------------------------------------
+
+#define FIELD_POWER     0x01
+#define FIELD_SET_TEMP  0x02
+#define FIELD_MODE      0x04
+#define FIELD_FAN       0x08
+#define FIELD_TIMER     0x10
+#define FIELD_SWING     0x20
+#define FIELD_ALL       0x3F
+
+// Returns the FIELD_* mask of fields that differ between a and b
+inline uint8_t settingsDiff(const HVACSettings& a, const HVACSettings& b) {
+  uint8_t mask = 0;
+  if (a.power != b.power) mask |= FIELD_POWER;
+  if (a.setTemp != b.setTemp) mask |= FIELD_SET_TEMP;
+  if (a.mode != b.mode) mask |= FIELD_MODE;
+  if (a.fanSpeed != b.fanSpeed) mask |= FIELD_FAN;
+  if (a.timer != b.timer) mask |= FIELD_TIMER;
+  if (a.swing != b.swing) mask |= FIELD_SWING;
+  return mask;
+}
+
+// Copies only the fields selected by mask from src into dst
+inline void applySettingsFields(HVACSettings& dst, const HVACSettings& src, uint8_t mask) {
+  if (mask & FIELD_POWER) dst.power = src.power;
+  if (mask & FIELD_SET_TEMP) dst.setTemp = src.setTemp;
+  if (mask & FIELD_MODE) dst.mode = src.mode;
+  if (mask & FIELD_FAN) dst.fanSpeed = src.fanSpeed;
+  if (mask & FIELD_TIMER) dst.timer = src.timer;
+  if (mask & FIELD_SWING) dst.swing = src.swing;
+}
+
+// Packs the fields selected by mask into one word (cache keys, hashing).
+// Unselected fields read as zero, so e.g. the IR cache can ignore the timer.
+inline uint32_t settingsKey(const HVACSettings& s, uint8_t mask = FIELD_ALL) {
+  uint32_t key = 0;
+  if (mask & FIELD_POWER) key |= (uint32_t)s.power;
+  if (mask & FIELD_SWING) key |= (uint32_t)s.swing << 1;
+  if (mask & FIELD_MODE) key |= (uint32_t)s.mode << 2;
+  if (mask & FIELD_FAN) key |= (uint32_t)s.fanSpeed << 5;
+  if (mask & FIELD_SET_TEMP) key |= (uint32_t)s.setTemp << 8;
+  if (mask & FIELD_TIMER) key |= (uint32_t)s.timer << 16;
+  return key;
+}
+
+// ----------------------------------------------------------------------------
+// Enum <-> name helpers
+// ----------------------------------------------------------------------------
+
+constexpr const char* modeName(uint8_t mode) {
+  return mode < MODE_COUNT ? kModeNames[mode] : kModeNames[MODE_COOL];
+}
+
+constexpr const char* fanName(uint8_t fan) {
+  return fan < FAN_COUNT ? kFanNames[fan] : kFanNames[FAN_AUTO];
+}
+
+constexpr const char* fanLabel(uint8_t fan) {
+  return fan < FAN_COUNT ? kFanLabels[fan] : kFanLabels[FAN_AUTO];
+}
+
+constexpr const char* onOffName(bool on) {
+  return kOnOffNames[on ? 1 : 0];
+}
+
+constexpr const char* onOffLabel(bool on) {
+  return kOnOffLabels[on ? 1 : 0];
+}
+
+constexpr const char* sourceName(uint8_t source) {
+  return source < SOURCE_COUNT ? kSourceNames[source] : kSourceNames[SOURCE_SYNCED];
+}
+
+// Name lookups return false (leaving out untouched) for null/unknown names
+inline bool lookupName(const char* name, const char* const* table, uint8_t count,
+                       uint8_t& out) {
+  if (name == nullptr) return false;
+  for (uint8_t i = 0; i < count; i++) {
+    if (strcmp(name, table[i]) == 0) {
+      out = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+inline bool parseMode(const char* name, uint8_t& out) {
+  return lookupName(name, kModeNames, MODE_COUNT, out);
+}
+
+inline bool parseFan(const char* name, uint8_t& out) {
+  return lookupName(name, kFanNames, FAN_COUNT, out);
+}
+
+inline bool parseOnOff(const char* name, bool& out) {
+  uint8_t value;
+  if (!lookupName(name, kOnOffNames, 2, value)) return false;
+  out = value != 0;
+  return true;
+}
+
+inline bool parseSource(const char* name, uint8_t& out) {
+  return lookupName(name, kSourceNames, SOURCE_COUNT, out);
+}
+
+inline uint8_t clampSetTemp(int temp) {
+  if (temp < HVAC_TEMP_MIN) return HVAC_TEMP_MIN;
+  if (temp > HVAC_TEMP_MAX) return HVAC_TEMP_MAX;
+  return (uint8_t)temp;
+}
+
+inline uint16_t clampTimer(int timer) {
+  if (timer < 0) return 0;
+  if (timer > HVAC_TIMER_MAX) return HVAC_TIMER_MAX;
+  return (uint16_t)timer;
+}
+
+#endif // HVAC_SETTINGS_H
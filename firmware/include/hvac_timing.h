@@ -0,0 +1,23 @@
+/*
+ * HVAC Timing - The intervals that set how fast a web command takes effect
+ *
+ * The hub's server polling, long-poll and heartbeat, its IR coalescing
+ * window and the R4's display tick. The sketches and the latency simulation
+ * (bench/bench_latency.cpp) both read them from here, so the simulation
+ * always models the intervals the boards actually run with.
+ */
+
+#ifndef HVAC_TIMING_H
+#define HVAC_TIMING_H
+
+// ESP8266 hub
+const unsigned long serverUpdateInterval = 2000;     // Flush pending changes to server every 2 seconds
+const unsigned long serverKeyframeInterval = 60000;  // Full state heartbeat every minute
+const unsigned long commandCheckInterval = 500;      // Poll server commands every 0.5 s while push is down
+const unsigned long pushWaitSeconds = 25;            // Server holds a long-poll this long
+const unsigned long irCoalesceWindow = 200;          // Send IR once changes pause this long
+
+// Arduino R4
+const unsigned long displayInterval = 100;           // Check displays for changes every 100ms
+
+#endif // HVAC_TIMING_H
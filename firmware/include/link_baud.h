@@ -0,0 +1,367 @@
+/*
+ * Link Baud - Adaptive UART rate for the R4 <-> ESP8266 link
+ *
+ * Both boards boot at LINK_BAUD_BASE, where HELLO and the JSON fallback
+ * always work. Once the binary link is up, the ESP8266 (the initiator)
+ * probes the next rate in kLinkBauds:
+ *
+ *   1. PROPOSE(i) at the current rate. The R4 answers ACCEPT(i), or
+ *      REFUSE(max) if i is above its own LINK_BAUD_MAX, and switches.
+ *   2. The initiator switches on ACCEPT and sends LINK_PROBE_FRAMES
+ *      PROBE frames, a CRC-checked test pattern the R4 echoes back.
+ *   3. With every echo intact it sends COMMIT(i) and, a moment later,
+ *      proposes the next rate. If not, both sides return to the last good
+ *      rate on their own when their probe window runs out, and that rate
+ *      becomes the ceiling until LINK_BAUD_REPROBE_MS has passed.
+ *
+ * Once settled, either side steps down a rate when its receive errors (CRC
+ * failures, overruns, sequence gaps) reach LINK_BAUD_MAX_ERRORS within a
+ * quality window, and both return to the base rate after hearing nothing
+ * for LINK_BAUD_LOST_MS. The initiator sends a PROBE as a keepalive while
+ * above the base rate so the R4 always has something to hear.
+ *
+ * There are no flow-control lines between the boards, so a receiver that
+ * can't keep up shows up as overruns and drives the rate down the same way.
+ *
+ * The state machine does no I/O. Each call returns LinkBaudAction bits:
+ * send the frame in outType/out/outLen at the current rate first, then
+ * flush the UART and reopen it at baud().
+ */
+
+#ifndef LINK_BAUD_H
+#define LINK_BAUD_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "hvac_link.h"
+
+#ifndef LINK_BAUD_MAX
+#define LINK_BAUD_MAX  460800   // Highest rate this board accepts; 9600 pins the link
+#endif
+
+#define LINK_BAUD_BASE           9600
+#define LINK_BAUD_COUNT          4
+#define LINK_PROBE_FRAMES        8
+#define LINK_PROBE_PATTERN_SIZE  24
+#define LINK_PROBE_SIZE          (3 + LINK_PROBE_PATTERN_SIZE)
+
+#define LINK_BAUD_PROPOSE_MS     500       // Wait this long for ACCEPT/REFUSE
+#define LINK_BAUD_SETTLE_MS      10        // Peer reopening its UART
+#define LINK_BAUD_PROBE_MS       1000      // Initiator: echoes due within this
+#define LINK_BAUD_COMMIT_MS      2000      // Responder: COMMIT due within this
+#define LINK_BAUD_STEP_MS        1000      // Between a COMMIT and the next PROPOSE
+#define LINK_BAUD_RETRY_MS       30000     // After an unanswered PROPOSE
+#define LINK_BAUD_REPROBE_MS     1800000UL // Try a failed rate again after 30 minutes
+#define LINK_BAUD_KEEPALIVE_MS   20000
+#define LINK_BAUD_LOST_MS        65000
+#define LINK_BAUD_WINDOW_MS      10000     // Quality window...
+#define LINK_BAUD_MAX_ERRORS     3         // ...and the errors that fail it
+
+static const uint32_t kLinkBauds[LINK_BAUD_COUNT] = { LINK_BAUD_BASE, 115200, 230400, 460800 };
+
+// LINK_MSG_BAUD payload: op, rate index
+enum LinkBaudOp : uint8_t {
+  LINK_BAUD_PROPOSE = 1,
+  LINK_BAUD_ACCEPT  = 2,
+  LINK_BAUD_REFUSE  = 3,   // Index is the highest the sender accepts
+  LINK_BAUD_COMMIT  = 4
+};
+
+enum LinkBaudAction : uint8_t {
+  LINK_BAUD_NONE   = 0,
+  LINK_BAUD_SEND   = 0x01,
+  LINK_BAUD_SWITCH = 0x02
+};
+
+inline uint8_t linkBaudMaxIndex() {
+  uint8_t i = 0;
+  while (i + 1 < LINK_BAUD_COUNT && kLinkBauds[i + 1] <= LINK_BAUD_MAX) i++;
+  return i;
+}
+
+// PROBE payload: rate index, number, echo flag, then a pattern of the bit
+// patterns a marginal line gets wrong (alternating bits, long runs, the
+// sync byte) mixed with an LFSR sequence seeded by index and number
+inline void linkProbeFill(uint8_t* p, uint8_t index, uint8_t n, bool echo) {
+  static const uint8_t fixed[] = { 0x55, 0xAA, 0x00, 0xFF, LINK_SYNC, 0x0F, 0xF0, 0x01 };
+  p[0] = index;
+  p[1] = n;
+  p[2] = echo ? 1 : 0;
+  uint8_t lfsr = (uint8_t)(0xB5 ^ (index << 4) ^ n);
+  if (lfsr == 0) lfsr = 1;
+  for (uint8_t i = 0; i < LINK_PROBE_PATTERN_SIZE; i++) {
+    if (i < sizeof(fixed)) {
+      p[3 + i] = fixed[i];
+    } else {
+      lfsr = (uint8_t)((lfsr >> 1) ^ ((lfsr & 1) ? 0xB8 : 0));
+      p[3 + i] = lfsr;
+    }
+  }
+}
+
+inline bool linkProbeValid(const uint8_t* p, uint8_t len) {
+  if (len != LINK_PROBE_SIZE) return false;
+  uint8_t expected[LINK_PROBE_SIZE];
+  linkProbeFill(expected, p[0], p[1], p[2] != 0);
+  return memcmp(p, expected, LINK_PROBE_SIZE) == 0;
+}
+
+// Receive errors on one side of the link since boot
+struct LinkErrors {
+  uint32_t crc;        // Frames failing their CRC, plus UART framing errors
+  uint32_t overruns;   // Bytes lost to a full UART FIFO or receive ring
+  uint32_t gaps;       // Sequence gaps (lost deltas)
+
+  uint32_t total() const { return crc + overruns + gaps; }
+};
+
+struct LinkBaud {
+  enum State : uint8_t { IDLE, PROPOSED, PROBING };
+
+  bool initiator;
+  uint8_t maxIndex;            // This board's LINK_BAUD_MAX
+  uint8_t index = 0;           // Current rate
+  uint8_t goodIndex = 0;       // Last rate both sides committed to
+  uint8_t ceiling;             // Initiator: highest rate worth proposing
+  State state = IDLE;
+  uint8_t proposed = 0;
+  uint32_t deadline = 0;
+  uint32_t switchedAt = 0;
+  uint32_t nextProposeAt = 0;
+  uint32_t reprobeAt = 0;
+  bool reprobePending = false;
+  uint32_t lastHeard = 0;
+  uint32_t lastSent = 0;
+  uint8_t probesSent = 0;
+  uint8_t probesOk = 0;
+
+  // Quality window over the caller's cumulative error count
+  uint32_t windowStart = 0;
+  uint32_t windowErrors = 0;   // Count at windowStart
+  bool windowRestart = true;   // Take a fresh count on the next poll
+
+  // Link quality since boot
+  uint16_t switches = 0;
+  uint16_t fallbacks = 0;      // Rate lowered after a failed probe, errors or silence
+  uint16_t probeFailures = 0;
+
+  uint8_t outType = 0;
+  uint8_t out[LINK_MAX_PAYLOAD];
+  uint8_t outLen = 0;
+
+  explicit LinkBaud(bool isInitiator)
+    : initiator(isInitiator), maxIndex(linkBaudMaxIndex()), ceiling(maxIndex) {}
+
+  uint32_t baud() const { return kLinkBauds[index]; }
+  bool settled() const { return state == IDLE; }
+
+  // Call once the peer has answered in binary (and again after a reboot)
+  void begin(uint32_t now) {
+    nextProposeAt = now + LINK_BAUD_STEP_MS;
+    lastHeard = now;
+    lastSent = now;
+  }
+
+  // Any valid frame from the peer
+  void heard(uint32_t now) {
+    lastHeard = now;
+  }
+
+  void sent(uint32_t now) {
+    lastSent = now;
+  }
+
+  int format(char* out, size_t size, const LinkErrors& e) const {
+    static const char* const states[] = { "", " proposed", " probing" };
+    return snprintf(out, size, "link %lu baud%s (max %lu) crc=%lu overruns=%lu gaps=%lu "
+                    "switches=%u fallbacks=%u probe_failures=%u",
+                    (unsigned long)baud(), states[state], (unsigned long)kLinkBauds[maxIndex],
+                    (unsigned long)e.crc, (unsigned long)e.overruns, (unsigned long)e.gaps,
+                    switches, fallbacks, probeFailures);
+  }
+
+  // Periodic step; errors is the caller's LinkErrors::total()
+  uint8_t poll(uint32_t now, uint32_t errors) {
+    if (windowRestart) {
+      windowRestart = false;
+      windowStart = now;
+      windowErrors = errors;
+    }
+    if (reprobePending && (int32_t)(now - reprobeAt) >= 0) {
+      reprobePending = false;
+      ceiling = maxIndex;
+    }
+
+    if (state == PROPOSED && (int32_t)(now - deadline) >= 0) {
+      state = IDLE;
+      nextProposeAt = now + LINK_BAUD_RETRY_MS;
+      // An unanswered step down means the peer isn't at this rate anymore
+      if (proposed < index) return fallBack(now, 0);
+    }
+
+    if (state == PROBING) {
+      if ((int32_t)(now - deadline) >= 0) {
+        probeFailures++;
+        if (initiator) limitCeiling(now, index);
+        return fallBack(now, goodIndex);
+      }
+      if (initiator && probesSent < LINK_PROBE_FRAMES && now - switchedAt >= LINK_BAUD_SETTLE_MS) {
+        linkProbeFill(out, index, probesSent++, false);
+        return send(LINK_MSG_PROBE, LINK_PROBE_SIZE, now);
+      }
+      return LINK_BAUD_NONE;
+    }
+
+    // Usually the peer rebooted, which is no reason to distrust the rate
+    if (index > 0 && now - lastHeard >= LINK_BAUD_LOST_MS) {
+      return fallBack(now, 0);
+    }
+
+    if (now - windowStart >= LINK_BAUD_WINDOW_MS) {
+      bool degraded = errors - windowErrors >= LINK_BAUD_MAX_ERRORS;
+      windowStart = now;
+      windowErrors = errors;
+      if (degraded && index > 0 && state == IDLE) {
+        if (initiator) limitCeiling(now, index);
+        return propose(index - 1, now);
+      }
+    }
+
+    if (state != IDLE) return LINK_BAUD_NONE;
+
+    if (initiator && index < ceiling && (int32_t)(now - nextProposeAt) >= 0) {
+      return propose(index + 1, now);
+    }
+
+    if (initiator && index > 0 && now - lastSent >= LINK_BAUD_KEEPALIVE_MS) {
+      linkProbeFill(out, index, 0xFF, false);
+      return send(LINK_MSG_PROBE, LINK_PROBE_SIZE, now);
+    }
+    return LINK_BAUD_NONE;
+  }
+
+  // A LINK_MSG_BAUD frame from the peer
+  uint8_t onBaud(const uint8_t* p, uint8_t len, uint32_t now) {
+    if (len < 2 || p[1] >= LINK_BAUD_COUNT) return LINK_BAUD_NONE;
+    uint8_t op = p[0];
+    uint8_t i = p[1];
+
+    switch (op) {
+      case LINK_BAUD_PROPOSE:
+        // A step down from the peer wins over our own step up
+        if (i > maxIndex || (state == PROPOSED && i > proposed)) {
+          return reply(LINK_BAUD_REFUSE, maxIndex, now);
+        }
+        {
+          uint8_t actions = reply(LINK_BAUD_ACCEPT, i, now);
+          if (i > goodIndex) {
+            state = PROBING;
+            deadline = now + LINK_BAUD_COMMIT_MS;
+          } else {
+            commit(i, now);
+          }
+          return actions | switchTo(i, now);
+        }
+
+      case LINK_BAUD_ACCEPT:
+        if (state != PROPOSED || i != proposed) return LINK_BAUD_NONE;
+        if (i > goodIndex) {
+          state = PROBING;
+          probesSent = 0;
+          probesOk = 0;
+          deadline = now + LINK_BAUD_PROBE_MS;
+        } else {
+          commit(i, now);
+        }
+        return switchTo(i, now);
+
+      case LINK_BAUD_REFUSE:
+        if (state != PROPOSED) return LINK_BAUD_NONE;
+        state = IDLE;
+        if (initiator && i < ceiling) {
+          ceiling = i;
+          maxIndex = i;   // The peer's limit doesn't change until it reboots
+        }
+        nextProposeAt = now + LINK_BAUD_RETRY_MS;
+        return LINK_BAUD_NONE;
+
+      case LINK_BAUD_COMMIT:
+        if (state == PROBING && i == index) commit(i, now);
+        return LINK_BAUD_NONE;
+    }
+    return LINK_BAUD_NONE;
+  }
+
+  // A LINK_MSG_PROBE frame from the peer: the responder echoes it, the
+  // initiator counts the echoes of this rate's probes
+  uint8_t onProbe(const uint8_t* p, uint8_t len, uint32_t now) {
+    if (!linkProbeValid(p, len)) return LINK_BAUD_NONE;
+    if (p[2] == 0) {
+      if (initiator) return LINK_BAUD_NONE;
+      linkProbeFill(out, p[0], p[1], true);
+      return send(LINK_MSG_PROBE, LINK_PROBE_SIZE, now);
+    }
+    if (!initiator || state != PROBING || p[0] != index || p[1] >= LINK_PROBE_FRAMES) {
+      return LINK_BAUD_NONE;
+    }
+    if (++probesOk < LINK_PROBE_FRAMES) return LINK_BAUD_NONE;
+    commit(index, now);
+    return reply(LINK_BAUD_COMMIT, index, now);
+  }
+
+private:
+  uint8_t propose(uint8_t i, uint32_t now) {
+    state = PROPOSED;
+    proposed = i;
+    deadline = now + LINK_BAUD_PROPOSE_MS;
+    return reply(LINK_BAUD_PROPOSE, i, now);
+  }
+
+  uint8_t reply(uint8_t op, uint8_t i, uint32_t now) {
+    out[0] = op;
+    out[1] = i;
+    return send(LINK_MSG_BAUD, 2, now);
+  }
+
+  uint8_t send(uint8_t type, uint8_t len, uint32_t now) {
+    outType = type;
+    outLen = len;
+    lastSent = now;
+    return LINK_BAUD_SEND;
+  }
+
+  void commit(uint8_t i, uint32_t now) {
+    if (i < goodIndex) fallbacks++;
+    goodIndex = i;
+    state = IDLE;
+    nextProposeAt = now + LINK_BAUD_STEP_MS;
+  }
+
+  uint8_t switchTo(uint8_t i, uint32_t now) {
+    if (i == index) return LINK_BAUD_NONE;
+    index = i;
+    switchedAt = now;
+    lastHeard = now;
+    windowRestart = true;   // Don't blame the new rate for bytes garbled by the switch
+    switches++;
+    return LINK_BAUD_SWITCH;
+  }
+
+  uint8_t fallBack(uint32_t now, uint8_t i) {
+    state = IDLE;
+    if (i < index) fallbacks++;
+    goodIndex = i;
+    nextProposeAt = now + LINK_BAUD_STEP_MS;
+    return switchTo(i, now);
+  }
+
+  // Don't propose `failed` again for a while
+  void limitCeiling(uint32_t now, uint8_t failed) {
+    if (failed == 0) return;
+    if (failed - 1 < ceiling) ceiling = failed - 1;
+    reprobeAt = now + LINK_BAUD_REPROBE_MS;
+    reprobePending = true;
+  }
+};
+
+#endif // LINK_BAUD_H
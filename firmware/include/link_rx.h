@@ -0,0 +1,99 @@
+/*
+ * HVAC Link Receiver - Non-blocking UART receive path
+ *
+ * Replaces Stream::readStringUntil(), which blocks loop() for up to the
+ * stream timeout on a partial line and allocates a String per message.
+ *
+ * Usage (once per loop pass):
+ *   1. drain whatever the UART has into the ring with write()
+ *   2. call poll() until it returns LINK_RX_NONE, handling each
+ *      LINK_RX_LINE (text in line, NUL-terminated, '\r' stripped) and
+ *      LINK_RX_FRAME (CRC-valid frame in frame.type/len/payload)
+ *
+ * All storage is fixed-size; nothing here touches the heap.
+ */
+
+#ifndef LINK_RX_H
+#define LINK_RX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hvac_link.h"
+
+#define LINK_RX_RING_SIZE  128   // Power of two
+#define LINK_RX_LINE_SIZE  256   // Longest JSON line accepted, including NUL
+
+enum LinkRxEvent : uint8_t {
+  LINK_RX_NONE = 0,
+  LINK_RX_LINE,
+  LINK_RX_FRAME
+};
+
+struct LinkReceiver {
+  uint8_t ring[LINK_RX_RING_SIZE];
+  uint16_t head = 0;          // Next write position
+  uint16_t tail = 0;          // Next read position
+
+  char line[LINK_RX_LINE_SIZE];
+  uint16_t lineLen = 0;
+  bool lineOverflow = false;  // Discarding until the next newline
+
+  LinkFrameParser frame;
+
+  uint16_t ringOverruns = 0;
+  uint16_t lineOverruns = 0;
+
+  uint16_t available() const {
+    return (uint16_t)(head - tail);
+  }
+
+  bool full() const {
+    return available() >= LINK_RX_RING_SIZE;
+  }
+
+  // Returns false (and counts an overrun) if the ring is full
+  bool write(uint8_t b) {
+    if (full()) {
+      ringOverruns++;
+      return false;
+    }
+    ring[head & (LINK_RX_RING_SIZE - 1)] = b;
+    head++;
+    return true;
+  }
+
+  // Consumes buffered bytes until a complete message is assembled
+  LinkRxEvent poll() {
+    while (available() > 0) {
+      uint8_t b = ring[tail & (LINK_RX_RING_SIZE - 1)];
+      tail++;
+
+      // Binary frames start with a sync byte that never appears in JSON text
+      if (frame.busy() || b == LINK_SYNC) {
+        if (frame.push(b)) return LINK_RX_FRAME;
+        continue;
+      }
+
+      if (b == '\n') {
+        bool complete = !lineOverflow && lineLen > 0;
+        line[lineLen] = '\0';
+        lineLen = 0;
+        lineOverflow = false;
+        if (complete) return LINK_RX_LINE;
+        continue;
+      }
+
+      if (b == '\r' || lineOverflow) continue;
+
+      if (lineLen >= LINK_RX_LINE_SIZE - 1) {
+        lineOverflow = true;
+        lineOverruns++;
+        continue;
+      }
+      line[lineLen++] = (char)b;
+    }
+    return LINK_RX_NONE;
+  }
+};
+
+#endif // LINK_RX_H
@@ -0,0 +1,60 @@
+/*
+ * LRU Cache - Small fixed-capacity cache keyed by a 32-bit word
+ *
+ * Linear scan over N entries, meant for N up to a few dozen. The least
+ * recently used entry is evicted on insert once the cache is full.
+ */
+
+#ifndef LRU_CACHE_H
+#define LRU_CACHE_H
+
+#include <stdint.h>
+
+template <typename Value, uint8_t N>
+struct LruCache {
+  struct Entry {
+    uint32_t key;
+    uint32_t stamp;   // Use counter at last access, 0 = empty
+    Value value;
+  };
+
+  Entry entries[N] = {};
+  uint32_t uses = 0;
+  uint32_t hits = 0;
+  uint32_t misses = 0;
+
+  // Returns the cached value (marking it most recently used), or nullptr
+  Value* find(uint32_t key) {
+    for (uint8_t i = 0; i < N; i++) {
+      if (entries[i].stamp != 0 && entries[i].key == key) {
+        entries[i].stamp = ++uses;
+        hits++;
+        return &entries[i].value;
+      }
+    }
+    misses++;
+    return nullptr;
+  }
+
+  // Claims a slot for key (an empty one, or the least recently used) and
+  // returns its value for the caller to fill in
+  Value& insert(uint32_t key) {
+    uint8_t victim = 0;
+    for (uint8_t i = 0; i < N; i++) {
+      if (entries[i].stamp == 0) {
+        victim = i;
+        break;
+      }
+      if (entries[i].stamp < entries[victim].stamp) victim = i;
+    }
+    entries[victim].key = key;
+    entries[victim].stamp = ++uses;
+    return entries[victim].value;
+  }
+
+  void clear() {
+    for (uint8_t i = 0; i < N; i++) entries[i].stamp = 0;
+  }
+};
+
+#endif // LRU_CACHE_H
@@ -0,0 +1,151 @@
+/*
+ * Memory Stats - Heap, fragmentation and stack health for both targets
+ *
+ * Each target fills a MemStats from its own allocator (memSample() in
+ * main.cpp): free heap, the largest block malloc could still hand out,
+ * fragmentation (how much of the free heap is not in that block) and the
+ * stack high-water mark (bytes never touched since boot).
+ *
+ * With -D MEM_COUNT_ALLOCS the linker wraps malloc/calloc/realloc/free (see
+ * platformio.ini) and the wrappers bump memCounters. MemLoopTracker turns
+ * that into allocations per loop() pass; in steady state it should be 0, and
+ * anything else is a String or JSON document allocating on the hot path.
+ *
+ * The R4 sends its stats to the ESP8266 as a LINK_MSG_MEM frame, so both
+ * boards show up in the hub's telemetry.
+ */
+
+#ifndef MEM_STATS_H
+#define MEM_STATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "hvac_link.h"
+
+// Allocator calls since boot, updated by the malloc wrappers
+struct MemCounters {
+  volatile uint32_t allocs;   // malloc, calloc and realloc calls
+  volatile uint32_t frees;    // free() of a non-null pointer
+};
+
+extern MemCounters memCounters;
+
+struct MemLoopTracker {
+  uint32_t startAllocs = 0;
+  uint16_t last = 0;          // Allocations in the last loop() pass
+  uint16_t max = 0;           // Worst pass since reset
+  uint32_t allocatingLoops = 0;
+  uint32_t loops = 0;
+
+  void begin() {
+    startAllocs = memCounters.allocs;
+  }
+
+  void end() {
+    uint32_t n = memCounters.allocs - startAllocs;
+    last = n > 0xFFFF ? 0xFFFF : (uint16_t)n;
+    if (last > max) max = last;
+    if (n) allocatingLoops++;
+    loops++;
+  }
+
+  void reset() {
+    max = 0;
+    allocatingLoops = 0;
+    loops = 0;
+  }
+};
+
+// Counts the allocations made until it goes out of scope
+struct MemLoopScope {
+  MemLoopTracker& tracker;
+  explicit MemLoopScope(MemLoopTracker& t) : tracker(t) { tracker.begin(); }
+  ~MemLoopScope() { tracker.end(); }
+};
+
+struct MemStats {
+  uint32_t freeHeap = 0;       // bytes
+  uint32_t maxFreeBlock = 0;   // bytes
+  uint8_t fragmentation = 0;   // percent
+  uint32_t stackFree = 0;      // bytes of stack never used since boot
+  uint32_t allocs = 0;
+  uint32_t frees = 0;
+  uint16_t loopAllocsLast = 0;
+  uint16_t loopAllocsMax = 0;
+
+  void setCounts(const MemLoopTracker& loop) {
+    allocs = memCounters.allocs;
+    frees = memCounters.frees;
+    loopAllocsLast = loop.last;
+    loopAllocsMax = loop.max;
+  }
+
+  int format(char* out, size_t size) const {
+    return snprintf(out, size, "heap=%lu block=%lu frag=%u%% stack=%lu allocs=%lu frees=%lu "
+                    "loop=%u max=%u",
+                    (unsigned long)freeHeap, (unsigned long)maxFreeBlock, fragmentation,
+                    (unsigned long)stackFree, (unsigned long)allocs, (unsigned long)frees,
+                    loopAllocsLast, loopAllocsMax);
+  }
+};
+
+// Share of the free heap outside the largest block, 0-100
+inline uint8_t memFragmentation(uint32_t freeHeap, uint32_t maxFreeBlock) {
+  if (freeHeap == 0 || maxFreeBlock >= freeHeap) return 0;
+  return (uint8_t)(100 - (uint32_t)((uint64_t)maxFreeBlock * 100 / freeHeap));
+}
+
+// ----------------------------------------------------------------------------
+// Stack painting, for targets without a runtime high-water mark
+// ----------------------------------------------------------------------------
+
+#define MEM_STACK_PAINT  0xC5C5C5C5UL
+
+// Fills [from, to) with the paint pattern; call once, early, below the live stack
+inline void memPaintStack(uint32_t* from, uint32_t* to) {
+  while (from < to) *from++ = MEM_STACK_PAINT;
+}
+
+// Bytes at the bottom of [from, to) still holding the paint (the stack grows down)
+inline uint32_t memUnpaintedStack(const uint32_t* from, const uint32_t* to) {
+  const uint32_t* p = from;
+  while (p < to && *p == MEM_STACK_PAINT) p++;
+  return (uint32_t)((p - from) * sizeof(uint32_t));
+}
+
+// ----------------------------------------------------------------------------
+// LINK_MSG_MEM payload (R4 -> ESP), all u16 except fragmentation:
+//   freeHeap, maxFreeBlock, fragmentation (u8), stackFree, allocs (low 16
+//   bits), loopAllocsLast, loopAllocsMax
+// The R4 has 32 KB of RAM, so 16 bits cover every size.
+// ----------------------------------------------------------------------------
+
+#define LINK_MEM_SIZE  13
+
+inline uint16_t memClamp16(uint32_t v) {
+  return v > 0xFFFF ? 0xFFFF : (uint16_t)v;
+}
+
+inline void linkPutMem(uint8_t* p, const MemStats& m) {
+  linkPutU16(p, memClamp16(m.freeHeap));
+  linkPutU16(p + 2, memClamp16(m.maxFreeBlock));
+  p[4] = m.fragmentation;
+  linkPutU16(p + 5, memClamp16(m.stackFree));
+  linkPutU16(p + 7, (uint16_t)m.allocs);
+  linkPutU16(p + 9, m.loopAllocsLast);
+  linkPutU16(p + 11, m.loopAllocsMax);
+}
+
+inline void linkGetMem(const uint8_t* p, MemStats& m) {
+  m.freeHeap = linkGetU16(p);
+  m.maxFreeBlock = linkGetU16(p + 2);
+  m.fragmentation = p[4];
+  m.stackFree = linkGetU16(p + 5);
+  m.allocs = linkGetU16(p + 7);
+  m.frees = 0;   // Not sent
+  m.loopAllocsLast = linkGetU16(p + 9);
+  m.loopAllocsMax = linkGetU16(p + 11);
+}
+
+#endif // MEM_STATS_H
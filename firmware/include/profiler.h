@@ -0,0 +1,122 @@
+/*
+ * Profiler - Fixed-memory timing spans for both firmware targets
+ *
+ * Each ProfileSpan keeps count, min, max, total and a log2 histogram of
+ * durations in microseconds. Nothing allocates; a span is 52 bytes on the
+ * 32-bit targets.
+ *
+ * Usage:
+ *   ProfileSpan profDisplay("display");
+ *   void updateDisplay() {
+ *     ProfileScope scope(profDisplay);   // records on return
+ *     ...
+ *   }
+ *
+ * For latencies that start and end in different places, call
+ * profDisplay.record(profileMicros() - startedAt) directly.
+ *
+ * Each target defines profileMicros() (micros() on the boards), which keeps
+ * this header free of Arduino types.
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define PROFILE_BUCKETS      16
+#define PROFILE_FIRST_SHIFT  6    // Bucket 0 is < 64 us; bucket i is < 64 us << i
+
+uint32_t profileMicros();
+
+struct ProfileSpan {
+  const char* name;
+  uint32_t count;
+  uint32_t min;    // us
+  uint32_t max;    // us
+  uint32_t total;  // us, wraps after ~71 minutes of accumulated time
+  uint16_t buckets[PROFILE_BUCKETS];
+
+  explicit ProfileSpan(const char* spanName) : name(spanName) {
+    reset();
+  }
+
+  void reset() {
+    count = 0;
+    min = 0xFFFFFFFFUL;
+    max = 0;
+    total = 0;
+    for (uint8_t i = 0; i < PROFILE_BUCKETS; i++) buckets[i] = 0;
+  }
+
+  static uint8_t bucketFor(uint32_t us) {
+    uint8_t i = 0;
+    us >>= PROFILE_FIRST_SHIFT;
+    while (us > 0 && i < PROFILE_BUCKETS - 1) {
+      us >>= 1;
+      i++;
+    }
+    return i;
+  }
+
+  // Upper bound of bucket i in microseconds
+  static uint32_t bucketLimit(uint8_t i) {
+    return (uint32_t)1 << (PROFILE_FIRST_SHIFT + i);
+  }
+
+  void record(uint32_t us) {
+    count++;
+    total += us;
+    if (us < min) min = us;
+    if (us > max) max = us;
+    uint8_t b = bucketFor(us);
+    if (buckets[b] < 0xFFFF) buckets[b]++;
+  }
+
+  uint32_t mean() const {
+    return count ? total / count : 0;
+  }
+
+  // Histogram estimate: upper bound of the bucket holding the pct-th sample,
+  // capped at the observed max
+  uint32_t percentile(uint8_t pct) const {
+    uint32_t samples = 0;
+    for (uint8_t i = 0; i < PROFILE_BUCKETS; i++) samples += buckets[i];
+    if (samples == 0) return 0;
+
+    uint32_t target = (samples * pct + 99) / 100;
+    uint32_t seen = 0;
+    for (uint8_t i = 0; i < PROFILE_BUCKETS; i++) {
+      seen += buckets[i];
+      if (seen >= target) {
+        uint32_t limit = bucketLimit(i);
+        return limit < max ? limit : max;
+      }
+    }
+    return max;
+  }
+
+  // One report line: name, count, min/mean/p95/max in us
+  int format(char* out, size_t size) const {
+    return snprintf(out, size, "%-12s n=%lu min=%lu avg=%lu p95=%lu max=%lu", name,
+                    (unsigned long)count, (unsigned long)(count ? min : 0),
+                    (unsigned long)mean(), (unsigned long)percentile(95),
+                    (unsigned long)max);
+  }
+};
+
+// Records the time from construction to destruction into a span
+struct ProfileScope {
+  ProfileSpan& span;
+  uint32_t start;
+
+  explicit ProfileScope(ProfileSpan& target) : span(target), start(profileMicros()) {}
+
+  ~ProfileScope() {
+    span.record(profileMicros() - start);
+  }
+};
+
+#endif // PROFILER_H
@@ -0,0 +1,171 @@
+/*
+ * Sensor Filter - Fixed-point smoothing, aggregation and deadband reporting
+ *
+ * The R4 runs every DHT22 reading (tenths of a unit) through:
+ *   1. the median of the last 3 raw samples, which removes one-sample spikes
+ *   2. outlier rejection against the smoothed value: a jump larger than
+ *      maxJump is dropped unless it lasts SENSOR_REJECT_LIMIT samples, in
+ *      which case it's a real step and the filter re-seeds
+ *   3. an exponential moving average, y += (x - y) / 2^shift, kept in Q8
+ *
+ * SensorDeadband decides when the smoothed value (hundredths, as on the link)
+ * is worth reporting: when it leaves the band around the last report, or when
+ * the heartbeat expires. SensorWindow keeps min/mean/max between keyframes so
+ * excursions inside the deadband still reach the server.
+ *
+ * Integer math only; nothing allocates.
+ */
+
+#ifndef SENSOR_FILTER_H
+#define SENSOR_FILTER_H
+
+#include <stdint.h>
+#include "hvac_link.h"
+
+#define SENSOR_EMA_FRACTION  8   // Fraction bits of the EMA state
+#define SENSOR_REJECT_LIMIT  3   // This many outliers in a row are accepted
+
+// v / 2^shift rounded to nearest, symmetric around zero
+inline int32_t sensorRoundShift(int32_t v, uint8_t shift) {
+  int32_t half = (int32_t)1 << (shift - 1);
+  return v >= 0 ? (v + half) >> shift : -((-v + half) >> shift);
+}
+
+inline int16_t sensorMedian3(int16_t a, int16_t b, int16_t c) {
+  if (a > b) { int16_t t = a; a = b; b = t; }
+  if (b > c) b = c;
+  return a > b ? a : b;
+}
+
+struct SensorFilter {
+  int16_t maxJump;        // tenths
+  uint8_t shift;          // EMA weight 1/2^shift
+  int16_t raw[3];
+  uint8_t rawCount = 0;
+  uint8_t rawNext = 0;
+  int32_t state = 0;      // Q8 tenths
+  bool seeded = false;
+  uint8_t rejectRun = 0;
+  uint32_t rejected = 0;  // Outliers dropped since boot
+
+  SensorFilter(int16_t jump, uint8_t emaShift) : maxJump(jump), shift(emaShift) {}
+
+  // Feeds one raw reading; returns false if it was dropped as an outlier
+  bool add(int16_t tenths) {
+    raw[rawNext] = tenths;
+    rawNext = (uint8_t)((rawNext + 1) % 3);
+    if (rawCount < 3) rawCount++;
+    int16_t x = rawCount < 3 ? tenths : sensorMedian3(raw[0], raw[1], raw[2]);
+    int32_t target = (int32_t)x << SENSOR_EMA_FRACTION;
+
+    if (!seeded) {
+      state = target;
+      seeded = true;
+      return true;
+    }
+
+    int32_t diff = target - state;
+    int32_t jump = (int32_t)maxJump << SENSOR_EMA_FRACTION;
+    if (diff > jump || diff < -jump) {
+      if (++rejectRun < SENSOR_REJECT_LIMIT) {
+        rejected++;
+        return false;
+      }
+      state = target;   // Persistent, so the room really changed
+      rejectRun = 0;
+      return true;
+    }
+
+    rejectRun = 0;
+    state += sensorRoundShift(diff, shift);
+    return true;
+  }
+
+  bool ready() const { return seeded; }
+
+  // Smoothed value in hundredths
+  int16_t value() const {
+    return (int16_t)sensorRoundShift(state * 10, SENSOR_EMA_FRACTION);
+  }
+};
+
+struct SensorDeadband {
+  int16_t band;           // hundredths
+  uint32_t heartbeat;     // ms
+  int16_t reported = 0;
+  uint32_t reportedAt = 0;
+  bool hasReport = false;
+
+  SensorDeadband(int16_t deadband, uint32_t heartbeatMs) : band(deadband), heartbeat(heartbeatMs) {}
+
+  // Takes the new value as the report and returns true when it left the
+  // band or the heartbeat is due
+  bool update(int16_t value, uint32_t now) {
+    int32_t d = (int32_t)value - reported;
+    if (hasReport && d < band && d > -band && now - reportedAt < heartbeat) {
+      return false;
+    }
+    reported = value;
+    reportedAt = now;
+    hasReport = true;
+    return true;
+  }
+};
+
+struct SensorWindow {
+  uint16_t count = 0;
+  int32_t sum = 0;
+  int16_t min = 0;
+  int16_t max = 0;
+
+  void add(int16_t v) {
+    if (count == 0 || v < min) min = v;
+    if (count == 0 || v > max) max = v;
+    sum += v;
+    count++;
+  }
+
+  void merge(const SensorWindow& w) {
+    if (w.count == 0) return;
+    if (count == 0 || w.min < min) min = w.min;
+    if (count == 0 || w.max > max) max = w.max;
+    sum += w.sum;
+    count += w.count;
+  }
+
+  int16_t mean() const {
+    if (count == 0) return 0;
+    return (int16_t)(sum >= 0 ? (sum + count / 2) / count : (sum - count / 2) / count);
+  }
+
+  void reset() {
+    count = 0;
+    sum = 0;
+  }
+};
+
+// Window payload appended to LINK_MSG_STATE (R4 -> ESP): sample count (u8),
+// then temp min/mean/max and humidity min/mean/max (u16 hundredths each)
+#define LINK_WINDOW_SIZE  13
+
+inline void linkPutWindow(uint8_t* p, const SensorWindow& temp, const SensorWindow& humidity) {
+  p[0] = temp.count > 0xFF ? 0xFF : (uint8_t)temp.count;
+  linkPutU16(p + 1, (uint16_t)temp.min);
+  linkPutU16(p + 3, (uint16_t)temp.mean());
+  linkPutU16(p + 5, (uint16_t)temp.max);
+  linkPutU16(p + 7, (uint16_t)humidity.min);
+  linkPutU16(p + 9, (uint16_t)humidity.mean());
+  linkPutU16(p + 11, (uint16_t)humidity.max);
+}
+
+inline void linkGetWindow(const uint8_t* p, SensorWindow& temp, SensorWindow& humidity) {
+  temp.count = humidity.count = p[0];
+  temp.min = (int16_t)linkGetU16(p + 1);
+  temp.sum = (int32_t)(int16_t)linkGetU16(p + 3) * p[0];
+  temp.max = (int16_t)linkGetU16(p + 5);
+  humidity.min = (int16_t)linkGetU16(p + 7);
+  humidity.sum = (int32_t)(int16_t)linkGetU16(p + 9) * p[0];
+  humidity.max = (int16_t)linkGetU16(p + 11);
+}
+
+#endif // SENSOR_FILTER_H
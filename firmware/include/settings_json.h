@@ -0,0 +1,55 @@
+/*
+ * Settings JSON - HVACSettings to and from ArduinoJson objects
+ *
+ * Shared by both firmware targets and the native benchmarks. The serial
+ * link's JSON fallback and the server API name two fields differently, so
+ * each call takes the key set to use.
+ */
+
+#ifndef SETTINGS_JSON_H
+#define SETTINGS_JSON_H
+
+#include <ArduinoJson.h>
+#include "hvac_settings.h"
+
+// JSON key names differ between the serial link (camelCase) and the
+// server API (snake_case); the values are the same on both.
+struct SettingsJsonKeys {
+  const char* setTemp;
+  const char* fanSpeed;
+};
+
+const SettingsJsonKeys kLinkJsonKeys = { "setTemp", "fanSpeed" };
+const SettingsJsonKeys kServerJsonKeys = { "set_temp", "fan_speed" };
+
+// Writes the fields selected by mask (FIELD_* bits, all by default)
+inline void writeSettingsJson(JsonObject obj, const HVACSettings& s, const SettingsJsonKeys& keys,
+                              uint8_t mask = FIELD_ALL) {
+  // Names come from constexpr tables, so ArduinoJson stores pointers, not copies
+  if (mask & FIELD_POWER) obj["power"] = onOffName(s.power);
+  if (mask & FIELD_SET_TEMP) obj[keys.setTemp] = s.setTemp;
+  if (mask & FIELD_MODE) obj["mode"] = modeName(s.mode);
+  if (mask & FIELD_FAN) obj[keys.fanSpeed] = fanName(s.fanSpeed);
+  if (mask & FIELD_TIMER) obj["timer"] = s.timer;
+  if (mask & FIELD_SWING) obj["swing"] = onOffName(s.swing);
+}
+
+// Applies every present and valid field; returns true if anything changed
+inline bool readSettingsJson(JsonObjectConst obj, HVACSettings& s, const SettingsJsonKeys& keys) {
+  HVACSettings updated = s;
+  bool on;
+  uint8_t code;
+
+  if (parseOnOff(obj["power"].as<const char*>(), on)) updated.power = on;
+  if (obj[keys.setTemp].is<int>()) updated.setTemp = clampSetTemp(obj[keys.setTemp].as<int>());
+  if (parseMode(obj["mode"].as<const char*>(), code)) updated.mode = code;
+  if (parseFan(obj[keys.fanSpeed].as<const char*>(), code)) updated.fanSpeed = code;
+  if (obj["timer"].is<int>()) updated.timer = clampTimer(obj["timer"].as<int>());
+  if (parseOnOff(obj["swing"].as<const char*>(), on)) updated.swing = on;
+
+  bool changed = updated != s;
+  s = updated;
+  return changed;
+}
+
+#endif // SETTINGS_JSON_H
@@ -0,0 +1,176 @@
+/*
+ * Task Scheduler - Fixed-capacity cooperative scheduler for both targets
+ *
+ * Replaces chains of `if (now - lastX >= xInterval)` checks in loop().
+ * Tasks are plain functions; each one must return quickly (nothing here can
+ * interrupt a running task).
+ *
+ * Per pass (call run() from loop()):
+ * - every due TASK_CRITICAL task runs (input, UART, IR)
+ * - every other due task runs in priority order, and the critical tasks get
+ *   another turn after each one, so a slow HTTP request or display flush
+ *   delays input by at most one task
+ *
+ * Periodic tasks keep their phase; a task that falls more than a period
+ * behind skips ahead instead of running back-to-back. A period of 0 means
+ * "every pass". One-shot tasks only run after trigger().
+ *
+ * Stats per task: runs, deadline misses (started more than `deadline` ms
+ * late), worst lateness and worst run time.
+ *
+ * Capacity is fixed at compile time. A registration past it returns
+ * TASK_NONE and the task never runs; `rejected` counts these so setup() can
+ * check once after registering everything. Size N with room to spare.
+ *
+ * The clock is injected so the scheduler stays free of Arduino headers.
+ */
+
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <stdint.h>
+
+typedef void (*TaskFn)();
+typedef uint32_t (*TaskClock)();
+
+enum TaskPriority : uint8_t {
+  TASK_CRITICAL = 0,  // Runs every pass and between other tasks
+  TASK_HIGH,
+  TASK_NORMAL,
+  TASK_BULK
+};
+
+#define TASK_NONE        0xFF
+#define TASK_NO_DEADLINE 0xFFFFFFFFUL
+
+struct Task {
+  const char* name;
+  TaskFn fn;
+  uint32_t period;      // ms, 0 = every pass
+  uint32_t deadline;    // ms of lateness tolerated before counting a miss
+  uint32_t nextRun;     // ms
+  TaskPriority priority;
+  bool oneShot;
+  bool pending;         // Due (periodic tasks are always pending)
+
+  // Stats
+  uint32_t runs;
+  uint32_t misses;
+  uint32_t maxLate;     // ms
+  uint32_t maxRun;      // ms
+};
+
+template <uint8_t N>
+struct TaskScheduler {
+  Task tasks[N];
+  uint8_t count = 0;
+  uint8_t rejected = 0;   // Registrations refused because all N slots were taken
+  TaskClock clock;
+
+  explicit TaskScheduler(TaskClock clockFn) : clock(clockFn) {}
+
+  // Adds a periodic task; returns its id or TASK_NONE (and counts it in
+  // rejected) when full. Ids stay valid: tasks are kept in insertion order.
+  uint8_t every(const char* name, TaskFn fn, uint32_t period, TaskPriority priority,
+                uint32_t deadline = TASK_NO_DEADLINE) {
+    return add(name, fn, period, priority, deadline, false);
+  }
+
+  // Adds a task that only runs after trigger(); TASK_NONE when full
+  uint8_t oneShot(const char* name, TaskFn fn, TaskPriority priority,
+                  uint32_t deadline = TASK_NO_DEADLINE) {
+    return add(name, fn, 0, priority, deadline, true);
+  }
+
+  // Runs the task after delay ms (periodic tasks are pulled forward, never pushed back).
+  // TASK_NONE is ignored.
+  void trigger(uint8_t id, uint32_t delay = 0) {
+    if (id >= count) return;
+    Task& t = tasks[id];
+    uint32_t at = clock() + delay;
+    if (!t.pending || (int32_t)(at - t.nextRun) < 0) {
+      t.nextRun = at;
+    }
+    t.pending = true;
+  }
+
+  void run() {
+    runCritical();
+    for (uint8_t p = TASK_HIGH; p <= TASK_BULK; p++) {
+      for (uint8_t i = 0; i < count; i++) {
+        if (tasks[i].priority == p && due(tasks[i], clock())) {
+          runTask(tasks[i]);
+          runCritical();
+        }
+      }
+    }
+  }
+
+  void resetStats() {
+    for (uint8_t i = 0; i < count; i++) {
+      tasks[i].runs = 0;
+      tasks[i].misses = 0;
+      tasks[i].maxLate = 0;
+      tasks[i].maxRun = 0;
+    }
+  }
+
+private:
+  uint8_t add(const char* name, TaskFn fn, uint32_t period, TaskPriority priority,
+              uint32_t deadline, bool oneShot) {
+    if (count >= N) {
+      rejected++;
+      return TASK_NONE;
+    }
+    Task& t = tasks[count];
+    t.name = name;
+    t.fn = fn;
+    t.period = period;
+    t.deadline = deadline;
+    t.nextRun = clock();
+    t.priority = priority;
+    t.oneShot = oneShot;
+    t.pending = !oneShot;
+    t.runs = 0;
+    t.misses = 0;
+    t.maxLate = 0;
+    t.maxRun = 0;
+    return count++;
+  }
+
+  static bool due(const Task& t, uint32_t now) {
+    return t.pending && (int32_t)(now - t.nextRun) >= 0;
+  }
+
+  void runCritical() {
+    for (uint8_t i = 0; i < count; i++) {
+      if (tasks[i].priority == TASK_CRITICAL && due(tasks[i], clock())) {
+        runTask(tasks[i]);
+      }
+    }
+  }
+
+  void runTask(Task& t) {
+    uint32_t start = clock();
+    uint32_t late = start - t.nextRun;
+    if (late > t.maxLate) t.maxLate = late;
+    if (late > t.deadline) t.misses++;
+
+    // Reschedule before running so the task can trigger itself
+    if (t.oneShot) {
+      t.pending = false;
+    } else if (t.period == 0 || late >= t.period) {
+      t.nextRun = start + t.period;
+    } else {
+      t.nextRun += t.period;
+    }
+
+    t.fn();
+
+    uint32_t elapsed = clock() - start;
+    if (elapsed > t.maxRun) t.maxRun = elapsed;
+    t.runs++;
+  }
+};
+
+#endif // TASK_SCHEDULER_H
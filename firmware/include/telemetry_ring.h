@@ -0,0 +1,88 @@
+/*
+ * Telemetry Ring - Fixed-size buffer of room condition samples
+ *
+ * The ESP8266 hub stores readings here while the server is unreachable and
+ * drains them later in batches (POST /api/data/batch). When the ring is full
+ * the oldest sample is overwritten and counted in dropped.
+ *
+ * Samples carry the hub's millis() timestamp. The batch includes the hub's
+ * current millis() as "now", so the server can convert sample times to
+ * wall-clock time without the hub needing a real-time clock.
+ */
+
+#ifndef TELEMETRY_RING_H
+#define TELEMETRY_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+struct TelemetrySample {
+  uint32_t t;         // millis() when taken
+  int16_t temp;       // centi-degrees C
+  uint16_t humidity;  // centi-percent RH
+};
+
+static_assert(sizeof(TelemetrySample) == 8, "TelemetrySample is stored raw in the spill file");
+
+template <uint16_t N>
+struct TelemetryRing {
+  TelemetrySample samples[N];
+  uint16_t head = 0;     // Oldest sample
+  uint16_t count = 0;
+  uint32_t dropped = 0;
+
+  uint16_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  bool full() const { return count >= N; }
+
+  void push(const TelemetrySample& s) {
+    if (full()) {
+      head = (uint16_t)((head + 1) % N);
+      count--;
+      dropped++;
+    }
+    samples[(head + count) % N] = s;
+    count++;
+  }
+
+  // i = 0 is the oldest sample
+  const TelemetrySample& at(uint16_t i) const {
+    return samples[(head + i) % N];
+  }
+
+  // Discards the n oldest samples
+  void pop(uint16_t n) {
+    if (n > count) n = count;
+    head = (uint16_t)((head + n) % N);
+    count -= n;
+  }
+};
+
+// Longest sample entry: "[4294967295,-32768,65535],"
+#define TELEMETRY_BATCH_ENTRY_MAX  27
+#define TELEMETRY_BATCH_OVERHEAD   40
+
+// Writes {"now":<ms>,"samples":[[t,temp,humidity],...]} (centi units) into out.
+// Returns the length, or 0 if out is too small.
+inline size_t telemetryBatchJson(char* out, size_t size, uint32_t now,
+                                 const TelemetrySample* samples, uint16_t n) {
+  int len = snprintf(out, size, "{\"now\":%lu,\"samples\":[", (unsigned long)now);
+  if (len < 0 || (size_t)len >= size) return 0;
+  size_t used = (size_t)len;
+
+  for (uint16_t i = 0; i < n; i++) {
+    len = snprintf(out + used, size - used, "%s[%lu,%d,%u]", i ? "," : "",
+                   (unsigned long)samples[i].t, samples[i].temp, samples[i].humidity);
+    if (len < 0 || (size_t)len >= size - used) return 0;
+    used += (size_t)len;
+  }
+
+  if (used + 3 > size) return 0;
+  out[used++] = ']';
+  out[used++] = '}';
+  out[used] = '\0';
+  return used;
+}
+
+#endif // TELEMETRY_RING_H
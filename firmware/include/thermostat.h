@@ -0,0 +1,135 @@
+/*
+ * Thermostat - Closed-loop room temperature control on the ESP8266 hub
+ *
+ * The AC regulates against its own sensor, up by the ceiling. The hub knows
+ * the real room temperature from the R4's DHT22 and corrects for it:
+ *
+ * - Hysteresis on power: the AC is switched off once the room is `band`
+ *   past the setpoint and back on once it's `band` short of it, with
+ *   minimum on and off times to protect the compressor.
+ * - PI on the setpoint sent to the AC: a persistent error moves the AC's
+ *   setpoint up to maxOffset away from the user's. The integral stops
+ *   growing while the output is saturated (anti-windup).
+ * - With the user's fan on auto, the fan follows the error.
+ *
+ * Only cool and heat are controlled; other modes, and power off, pass the
+ * user's settings through untouched. Temperatures are centi-degrees C and
+ * gains are fixed point, so there is no float math.
+ *
+ * update() runs periodically and advances the controller; apply() maps the
+ * user's settings to what the AC should be sent, and is cheap to call on
+ * every change.
+ */
+
+#ifndef THERMOSTAT_H
+#define THERMOSTAT_H
+
+#include <stdint.h>
+#include "hvac_settings.h"
+
+#define THERMOSTAT_Q16  65536L
+
+struct ThermostatConfig {
+  int16_t band;        // centi-C either side of the setpoint for power cycling
+  int16_t kpQ8;        // Setpoint offset per unit of error, Q8
+  int32_t kiQ16;       // Integral gain per second, Q16
+  int16_t maxOffset;   // centi-C the AC setpoint may move from the user's
+  int16_t fanMedium;   // Error (centi-C) from which auto fan runs medium...
+  int16_t fanHigh;     // ...and high
+  uint32_t minOnMs;
+  uint32_t minOffMs;
+};
+
+inline int32_t thermostatClamp(int32_t v, int32_t limit) {
+  return v > limit ? limit : (v < -limit ? -limit : v);
+}
+
+struct Thermostat {
+  ThermostatConfig cfg;
+  int32_t integral = 0;     // Q16 centi-C
+  int16_t offset = 0;       // Last PI output, centi-C
+  int16_t error = 0;        // Last error, positive = room needs conditioning
+  bool running = true;      // Hysteresis state: AC on
+  bool hasSwitched = false;
+  uint32_t switchedAt = 0;
+  uint32_t lastUpdate = 0;
+  bool started = false;
+  uint8_t mode = MODE_COOL;
+
+  explicit Thermostat(const ThermostatConfig& config) : cfg(config) {}
+
+  static bool controls(const HVACSettings& user) {
+    return user.power && (user.mode == MODE_COOL || user.mode == MODE_HEAT);
+  }
+
+  void reset() {
+    integral = 0;
+    offset = 0;
+    error = 0;
+    running = true;
+    hasSwitched = false;
+    started = false;
+  }
+
+  // Advances the controller with a fresh room temperature
+  void update(const HVACSettings& user, int16_t room, uint32_t now) {
+    if (!controls(user) || (started && user.mode != mode)) {
+      reset();
+      if (!controls(user)) return;
+    }
+    mode = user.mode;
+
+    int32_t setpoint = (int32_t)user.setTemp * 100;
+    int32_t e = mode == MODE_COOL ? room - setpoint : setpoint - room;
+    error = (int16_t)thermostatClamp(e, 0x7FFF);
+
+    uint32_t dt = started ? (now - lastUpdate) / 1000 : 0;
+    if (dt > 60) dt = 60;   // After a stall don't integrate a minute's worth at once
+    lastUpdate = now;
+    started = true;
+
+    // Hysteresis with minimum on/off times
+    bool canSwitch = !hasSwitched || now - switchedAt >= (running ? cfg.minOnMs : cfg.minOffMs);
+    if (canSwitch && ((running && e < -cfg.band) || (!running && e > cfg.band))) {
+      running = !running;
+      switchedAt = now;
+      hasSwitched = true;
+    }
+    if (!running) {
+      return;   // Keep the learned integral for the next run
+    }
+
+    // PI with conditional integration
+    int32_t p = e * cfg.kpQ8 / 256;
+    int32_t u = p + integral / THERMOSTAT_Q16;
+    bool windingUp = (u >= cfg.maxOffset && e > 0) || (u <= -cfg.maxOffset && e < 0);
+    if (!windingUp) {
+      integral += e * cfg.kiQ16 * (int32_t)dt;
+      integral = thermostatClamp(integral, (int32_t)cfg.maxOffset * THERMOSTAT_Q16);
+    }
+    offset = (int16_t)thermostatClamp(p + integral / THERMOSTAT_Q16, cfg.maxOffset);
+  }
+
+  // The settings to send the AC for the user's settings
+  HVACSettings apply(const HVACSettings& user) const {
+    HVACSettings out = user;
+    if (!controls(user) || !started || user.mode != mode) {
+      return out;
+    }
+    out.power = running;
+    if (!running) {
+      return out;
+    }
+
+    // Cooling harder means a lower AC setpoint; heating harder, a higher one
+    int32_t target = (int32_t)user.setTemp * 100 + (mode == MODE_COOL ? -offset : offset);
+    out.setTemp = clampSetTemp((int)((target + (target >= 0 ? 50 : -50)) / 100));
+
+    if (user.fanSpeed == FAN_AUTO) {
+      out.fanSpeed = error >= cfg.fanHigh ? FAN_HIGH : (error >= cfg.fanMedium ? FAN_MEDIUM : FAN_LOW);
+    }
+    return out;
+  }
+};
+
+#endif // THERMOSTAT_H
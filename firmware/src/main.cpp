@@ -12,6 +12,88 @@
 
 #include <Arduino.h>
 #include <ArduinoJson.h>
+#include "hvac_settings.h"
+#include "hvac_link.h"
+#include "hvac_timing.h"
+#include "link_rx.h"
+#include "link_baud.h"
+#include "task_scheduler.h"
+#include "profiler.h"
+#include "lru_cache.h"
+#include "telemetry_ring.h"
+#include "hvac_schedule.h"
+#include "mem_stats.h"
+#include "sensor_filter.h"
+#include "thermostat.h"
+#include "settings_json.h"
+
+// ============================================================================
+// SHARED CODE (both targets)
+// ============================================================================
+
+// Profiling clock for profiler.h
+uint32_t profileMicros() {
+  return micros();
+}
+
+// Allocator call counts for mem_stats.h
+MemCounters memCounters = {0, 0};
+
+#ifdef MEM_COUNT_ALLOCS
+// Linked with -Wl,--wrap=<fn>: calls to fn land in __wrap_fn, and
+// __real_fn is the C library's version
+#ifdef ESP8266
+#define MEM_WRAP_ATTR IRAM_ATTR   // The SDK can allocate with the flash cache off
+#else
+#define MEM_WRAP_ATTR
+#endif
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+MEM_WRAP_ATTR void* __wrap_malloc(size_t size) {
+  memCounters.allocs++;
+  return __real_malloc(size);
+}
+
+MEM_WRAP_ATTR void* __wrap_calloc(size_t n, size_t size) {
+  memCounters.allocs++;
+  return __real_calloc(n, size);
+}
+
+MEM_WRAP_ATTR void* __wrap_realloc(void* ptr, size_t size) {
+  memCounters.allocs++;   // String growth shows up here
+  return __real_realloc(ptr, size);
+}
+
+MEM_WRAP_ATTR void __wrap_free(void* ptr) {
+  if (ptr) memCounters.frees++;
+  __real_free(ptr);
+}
+}
+#endif
+
+// Debug report: every span, then the scheduler's per-task stats
+void printProfile(Print& out, ProfileSpan* const* spans, uint8_t spanCount,
+                  const Task* tasks, uint8_t taskCount) {
+  char line[96];
+  out.println("-- spans (us) --");
+  for (uint8_t i = 0; i < spanCount; i++) {
+    spans[i]->format(line, sizeof(line));
+    out.println(line);
+  }
+  out.println("-- tasks (ms) --");
+  for (uint8_t i = 0; i < taskCount; i++) {
+    const Task& t = tasks[i];
+    snprintf(line, sizeof(line), "%-12s runs=%lu misses=%lu late=%lu run=%lu", t.name,
+             (unsigned long)t.runs, (unsigned long)t.misses, (unsigned long)t.maxLate,
+             (unsigned long)t.maxRun);
+    out.println(line);
+  }
+}
 
 // ============================================================================
 // ARDUINO UNO R4 MINIMA CODE
@@ -43,7 +125,10 @@
 
 #include <Wire.h>
 #include <U8g2lib.h>
-#include <DHT.h>
+#include <malloc.h>
+#include <unistd.h>
+#include "dht22_frame.h"
+#include "display_layout.h"
 
 // Display 1 - Room Conditions (SPI)
 #define OLED1_CLK    13
@@ -61,7 +146,6 @@
 
 // DHT22 Sensor
 #define DHTPIN 2
-#define DHTTYPE DHT22
 
 // Rotary Encoder
 #define ENCODER_CLK 3
@@ -76,27 +160,89 @@
 U8G2_SSD1306_128X64_NONAME_F_4W_HW_SPI display1(U8G2_R0, OLED1_CS, OLED1_DC, OLED1_RESET);
 U8G2_SSD1306_128X64_NONAME_F_4W_HW_SPI display2(U8G2_R0, OLED2_CS, OLED2_DC, OLED2_RESET);
 
-// Create DHT sensor object
-DHT dht(DHTPIN, DHTTYPE);
+// Full framebuffer geometry in 8x8 tiles (SSD1306 pages are one tile row each)
+#define OLED_TILE_WIDTH   16
+#define OLED_TILE_HEIGHT  8
+#define OLED_ROW_BYTES    (OLED_TILE_WIDTH * 8)
+#define OLED_BUFFER_SIZE  (OLED_ROW_BYTES * OLED_TILE_HEIGHT)
+
+// Last frame sent to each panel, diffed to send only the tiles that changed
+uint8_t display1Shadow[OLED_BUFFER_SIZE];
+uint8_t display2Shadow[OLED_BUFFER_SIZE];
+
+// DHT22 reader: a falling-edge interrupt captures the frame (see dht22_frame.h)
+enum DhtState {
+  DHT_IDLE,       // Waiting for the next reading
+  DHT_START,      // Holding the start pulse low
+  DHT_CAPTURE     // Line released, ISR timestamping edges
+};
+
+Dht22Capture dhtCapture;
+DhtState dhtState = DHT_IDLE;
+unsigned long dhtStateStart = 0;  // micros() when the current state began
+uint16_t dhtErrors = 0;
+const unsigned long dhtStartPulse = 1100;     // us, DHT22 needs at least 1 ms
+const unsigned long dhtCaptureTimeout = 8000; // us, a full frame takes ~5 ms
+
+// Quadrature encoder, decoded in encoderISR() on every CLK edge. DT (D4) has
+// no external interrupt on the R4 Minima, so it is sampled on CLK edges.
+// The ISR is the only writer; 32-bit loads are atomic on the Cortex-M4.
+volatile int32_t encoderPos = 0;         // Raw steps
+volatile int32_t encoderAccelPos = 0;    // Steps weighted by spin speed
+volatile uint8_t encoderState = 0;       // Last sample, (CLK << 1) | DT
+volatile int8_t encoderLastDir = 0;
+volatile uint32_t encoderLastStep = 0;   // micros() of the last step
+
+// Gray-code filter indexed by (previous state << 2) | new state. A sample
+// whose CLK level didn't change is a glitch and counts 0; otherwise
+// CLK != DT is clockwise. Contact bounce produces +1/-1 pairs that cancel.
+const int8_t encoderTable[16] = {
+//  new: 00  01  10  11
+          0,  0, +1, -1,   // prev 00
+          0,  0, +1, -1,   // prev 01
+         -1, +1,  0,  0,   // prev 10
+         -1, +1,  0,  0    // prev 11
+};
 
-// Simple encoder state tracking
-volatile int encoderPos = 0;
-volatile bool encoderClkLast = HIGH;
+// Acceleration: steps closer together than these count 4x / 2x
+const uint32_t encoderFastStep = 8000;     // us
+const uint32_t encoderMediumStep = 25000;  // us
 
-// HVAC Settings
-struct HVACSettings {
-  String power = "on";
-  int setTemp = 24;
-  String mode = "cool";
-  String fanSpeed = "medium";
-  int timer = 0;
-  String swing = "on";
-} hvacSettings;
+// HVAC Settings (see hvac_settings.h)
+HVACSettings hvacSettings;
 
-// Room conditions
+// Room conditions (smoothed, for the display)
 float roomTemp = 0.0;
 float roomHumidity = 0.0;
 
+// Sensor pipeline (see sensor_filter.h). Filters take the DHT22's tenths;
+// deadbands and windows work in hundredths like the link.
+const unsigned long sensorHeartbeat = 300000;      // Report at least every 5 minutes
+SensorFilter tempFilter(50, 2);                     // Drop jumps over 5 C, EMA weight 1/4
+SensorFilter humidityFilter(100, 2);                // Drop jumps over 10 %RH
+SensorDeadband tempReport(20, sensorHeartbeat);     // Report 0.2 C moves
+SensorDeadband humidityReport(100, sensorHeartbeat); // Report 1 %RH moves
+SensorWindow tempWindow;                            // Since the last keyframe
+SensorWindow humidityWindow;
+
+// Link protocol state (see hvac_link.h / link_rx.h)
+LinkReceiver linkRx;
+bool linkBinary = false;        // Peer understands binary frames
+unsigned long lastHelloSend = 0;
+const unsigned long helloInterval = 10000;  // Re-announce while on JSON fallback
+LinkBaud linkBaud(false);       // Link rate; the ESP proposes, we answer (see link_baud.h)
+
+// Delta sync: what the ESP last received from us
+HVACSettings sentSettings;
+LinkConditions sentConditions = { 0, 0 };
+uint8_t linkTxSeq = 0;
+LinkSeqTracker linkRxSeq;
+bool keyframeRequested = true;  // Start with a full state
+
+// Display acknowledgement for command latency tracing
+uint8_t ackSeq = 0;             // Last ESP settings message applied
+bool ackPending = false;        // ACK once it has been drawn
+
 // Menu system
 enum MenuState {
   MENU_BROWSE,    // Browsing between windows
@@ -115,43 +261,140 @@ MenuState menuState = MENU_BROWSE;
 SettingWindow currentWindow = WINDOW_TEMP;
 SettingWindow highlightedWindow = WINDOW_TEMP;
 
+// Settings screen layout (see display_layout.h), indexed by SettingWindow
+constexpr WindowLayout kWindowLayout[WINDOW_COUNT] = {
+  makeWindow(2, 16, 60, 24, "TEMP"),     // Top left
+  makeWindow(66, 16, 60, 24, "FAN"),     // Top right
+  makeWindow(66, 42, 60, 24, "SWING"),   // Bottom right
+  makeWindow(2, 42, 60, 24, "TIMER")     // Bottom left
+};
+constexpr const char* kSettingsTitles[2] = { "AC Settings [OFF]", "AC Settings [ON]" };
+
 // Button debouncing
 unsigned long lastEncoderPress = 0;
 unsigned long lastPowerPress = 0;
 const unsigned long debounceDelay = 200;
 
-// Encoder state
-int lastEncoderPos = 0;
+// Encoder state consumed by handleEncoder()
+int32_t lastEncoderPos = 0;
+int32_t lastEncoderAccelPos = 0;
+
+// Render models: what each display currently shows. A display is only
+// redrawn when its model changes (or a full redraw is forced), and text is
+// only reformatted when the value behind it does.
+struct RoomView {
+  CachedText<10> temp;       // Keyed by tenths of a degree
+  CachedText<10> humidity;   // Keyed by whole %RH
+};
+
+struct SettingsView {
+  HVACSettings settings;
+  uint8_t menuState;
+  uint8_t highlighted;
+  uint8_t current;
+};
+
+RoomView shownRoom;
+SettingsView shownSettings;
+CachedText<8> windowText[WINDOW_COUNT];   // Value text of each settings window
+bool displaysInvalid = true;    // Redraw both on the next pass
+
+// Idle: without knob or button input the panels dim, then blank to save
+// power and OLED burn-in. Any input wakes them; input that finds them blank
+// only wakes them.
+enum DisplayIdle {
+  DISPLAY_AWAKE,
+  DISPLAY_DIM,
+  DISPLAY_BLANK
+};
+
+DisplayIdle displayIdle = DISPLAY_AWAKE;
+unsigned long lastInput = 0;
+const unsigned long displayDimTimeout = 60000;     // Dim after 1 minute...
+const unsigned long displayBlankTimeout = 600000;  // ...blank after 10 minutes
+const uint8_t displayContrast = 0xFF;
+const uint8_t displayDimContrast = 0x10;
+
+// Cooperative scheduler (see task_scheduler.h); setup() registers 8, the
+// rest is headroom so a new task doesn't silently fail to register
+TaskScheduler<12> scheduler([]() -> uint32_t { return millis(); });
+
+// Profiling spans (see profiler.h); "prof" on the USB serial prints them
+ProfileSpan profLoop("loop");
+ProfileSpan profDHT("dht");
+ProfileSpan profDisplay1("display1");
+ProfileSpan profDisplay2("display2");
+ProfileSpan profLinkTx("link_tx");
+ProfileSpan profKnobToLink("knob_to_link");  // Local change until it's on the wire
+ProfileSpan* const profSpans[] = {
+  &profLoop, &profDHT, &profDisplay1, &profDisplay2, &profLinkTx, &profKnobToLink
+};
+uint32_t localChangeAt = 0;     // micros() of the oldest unsent local change
+bool localChangePending = false;
+
+// Heap and stack health (see mem_stats.h); "mem" on the USB serial prints it
+// and the ESP forwards it to the server
+MemLoopTracker memLoop;
+const unsigned long memReportInterval = 10000;  // LINK_MSG_MEM every 10 seconds
+
+// USB serial debug commands
+char debugLine[32];
+uint8_t debugLineLen = 0;
 
-// Update intervals
+// Update intervals (displayInterval is in hvac_timing.h)
 unsigned long lastDHTRead = 0;
-unsigned long lastDisplayUpdate = 0;
 unsigned long lastDataSend = 0;
-const unsigned long dhtInterval = 2000;      // Read DHT every 2 seconds
-const unsigned long displayInterval = 100;    // Update display every 100ms
-const unsigned long dataSendInterval = 1000;  // Send data every 1 second
+unsigned long lastKeyframeSend = 0;
+const unsigned long dhtInterval = 2000;        // Start a DHT reading every 2 seconds
+const unsigned long deltaMinGap = 50;           // Coalesce changes during fast knob spins
+const unsigned long keyframeInterval = 30000;   // Full state resync every 30 seconds
 
 // Function declarations
 void initDisplays();
+void updateDisplays();
 void updateDisplay1();
 void updateDisplay2();
-void readDHT();
+void flushDisplay(U8G2 &u8g2, uint8_t* shadow);
+void serviceDHT();
+void dhtISR();
+void addReading(const Dht22Reading& reading);
 void handleEncoder();
+void encoderISR();
 void handleButtons();
+void markLocalChange();
+void serviceDebugSerial();
+void handleDebugCommand(const char* cmd);
+void paintStack();
+MemStats memSample();
+void sendMemToESP();
 void sendDataToESP();
+void sendLinkFrame(uint8_t type, const uint8_t* payload, uint8_t len);
+LinkConditions currentConditions();
 void receiveDataFromESP();
-void drawWindow(U8G2 &u8g2, int x, int y, int w, int h, 
-                const char* title, const char* value, bool highlighted, bool selected);
+void handleJsonLine(char* line);
+void sendLinkHello();
+void handleLinkFrame();
+void serviceLinkBaud();
+void applyLinkBaud(uint8_t actions);
+LinkErrors linkErrors();
+void updateWindowText();
+void serviceDisplayIdle();
+void setDisplayIdle(DisplayIdle state);
+bool wakeOnInput();
+void drawWindow(U8G2 &u8g2, const WindowLayout& window, bool highlighted, bool selected);
 
 void setup() {
   Serial.begin(115200);  // USB debugging (USB CDC)
+  paintStack();
   
   // Initialize Hardware Serial1 (pins D0=RX, D1=TX) to talk to ESP8266
-  // Use 9600 baud to reduce signal stress when level shifting isn't available
-  Serial1.begin(9600);
+  // Starts at 9600 baud; the ESP probes faster rates once the binary link is
+  // up and both fall back if errors rise (build with -D LINK_BAUD_MAX=9600
+  // to stay at 9600 when level shifting isn't available)
+  Serial1.begin(LINK_BAUD_BASE);
   
   Serial.println("Arduino R4 Minima HVAC Controller");
-  Serial.println("ESP Serial: RX=D0, TX=D1 @ 9600 baud");
+  Serial.println("ESP Serial: RX=D0, TX=D1 @ 9600 baud (adaptive)");
   Serial.println("WARNING: R4 TX is 5V and ESP RX is 3.3V – use a level shifter if possible.");
   
   // Initialize displays
@@ -173,8 +416,8 @@ void setup() {
   
   delay(2000);
   
-  // Initialize DHT sensor
-  dht.begin();
+  // DHT22 data line idles high
+  pinMode(DHTPIN, INPUT_PULLUP);
   
   // Initialize buttons
   pinMode(ENCODER_SW, INPUT_PULLUP);
@@ -183,76 +426,163 @@ void setup() {
   // Initialize encoder pins
   pinMode(ENCODER_CLK, INPUT_PULLUP);
   pinMode(ENCODER_DT, INPUT_PULLUP);
-  encoderClkLast = digitalRead(ENCODER_CLK);
+  encoderState = (digitalRead(ENCODER_CLK) << 1) | digitalRead(ENCODER_DT);
   encoderPos = 0;
+  encoderAccelPos = 0;
   lastEncoderPos = 0;
+  lastEncoderAccelPos = 0;
+  attachInterrupt(digitalPinToInterrupt(ENCODER_CLK), encoderISR, CHANGE);
+  
+  // Offer the binary link protocol; JSON stays in use until the ESP answers
+  sendLinkHello();
   
   // Final clear after init (not strictly necessary)
   display1.clearBuffer();
   display1.sendBuffer();
   display2.clearBuffer();
   display2.sendBuffer();
+  
+  // Both panels are blank now; the first flush sends only what gets drawn
+  memset(display1Shadow, 0, sizeof(display1Shadow));
+  memset(display2Shadow, 0, sizeof(display2Shadow));
+  
+  // Input, the DHT capture and the UART run every pass and between other tasks
+  scheduler.every("dht", serviceDHT, 0, TASK_CRITICAL);
+  scheduler.every("encoder", handleEncoder, 0, TASK_CRITICAL);
+  scheduler.every("buttons", handleButtons, 0, TASK_CRITICAL);
+  scheduler.every("link_rx", receiveDataFromESP, 0, TASK_CRITICAL);
+  
+  // Send changes to ESP8266 as soon as they happen (plus periodic keyframes)
+  scheduler.every("link_tx", sendDataToESP, 0, TASK_HIGH);
+  
+  // Redraw displays whose content changed (no-op otherwise)
+  scheduler.every("display", updateDisplays, displayInterval, TASK_NORMAL, displayInterval);
+  scheduler.every("debug", serviceDebugSerial, 50, TASK_BULK);
+  scheduler.every("mem", sendMemToESP, memReportInterval, TASK_BULK, memReportInterval);
+  if (scheduler.rejected > 0) {
+    Serial.print("ERROR: scheduler full, tasks not registered: ");
+    Serial.println(scheduler.rejected);
+  }
 }
 
 void loop() {
-  unsigned long currentTime = millis();
-  
-  // Read DHT sensor periodically
-  if (currentTime - lastDHTRead >= dhtInterval) {
-    lastDHTRead = currentTime;
-    readDHT();
-  }
-  
-  // Handle encoder and buttons
-  handleEncoder();
-  handleButtons();
-  
-  // Update displays periodically
-  if (currentTime - lastDisplayUpdate >= displayInterval) {
-    lastDisplayUpdate = currentTime;
-    updateDisplay1();
-    updateDisplay2();
+  {
+    ProfileScope scope(profLoop);
+    MemLoopScope memScope(memLoop);
+    scheduler.run();
   }
   
-  // Send data to ESP8266 periodically
-  if (currentTime - lastDataSend >= dataSendInterval) {
-    lastDataSend = currentTime;
-    sendDataToESP();
+  // Sleep until the next interrupt: encoder, DHT edge, UART or USB RX, or the
+  // 1 ms tick behind millis(); polled inputs are still checked every tick
+  __WFI();
+}
+
+void serviceDHT() {
+  ProfileScope scope(profDHT);
+  unsigned long now = micros();
+  
+  switch (dhtState) {
+    case DHT_IDLE:
+      if (millis() - lastDHTRead >= dhtInterval) {
+        lastDHTRead = millis();
+        
+        // Start pulse: hold the line low
+        pinMode(DHTPIN, OUTPUT);
+        digitalWrite(DHTPIN, LOW);
+        dhtStateStart = now;
+        dhtState = DHT_START;
+      }
+      break;
+      
+    case DHT_START:
+      if (now - dhtStateStart >= dhtStartPulse) {
+        // Release the line and let the ISR capture the sensor's reply
+        dhtCapture.reset();
+        pinMode(DHTPIN, INPUT_PULLUP);
+        attachInterrupt(digitalPinToInterrupt(DHTPIN), dhtISR, FALLING);
+        dhtStateStart = micros();
+        dhtState = DHT_CAPTURE;
+      }
+      break;
+      
+    case DHT_CAPTURE:
+      if (dhtCapture.complete() || now - dhtStateStart >= dhtCaptureTimeout) {
+        detachInterrupt(digitalPinToInterrupt(DHTPIN));
+        
+        Dht22Reading reading;
+        if (dhtCapture.decode(reading)) {
+          addReading(reading);
+        } else {
+          dhtErrors++;  // Keep the last good reading
+        }
+        dhtState = DHT_IDLE;
+      }
+      break;
   }
-  
-  // Check for data from ESP8266
-  receiveDataFromESP();
 }
 
-void readDHT() {
-  float h = dht.readHumidity();
-  float t = dht.readTemperature();
+void dhtISR() {
+  dhtCapture.edge(micros());
+}
+
+void addReading(const Dht22Reading& reading) {
+  tempFilter.add(reading.temp);
+  humidityFilter.add((int16_t)reading.humidity);
+  
+  int16_t temp = tempFilter.value();
+  int16_t humidity = humidityFilter.value();
+  roomTemp = temp / 100.0f;
+  roomHumidity = humidity / 100.0f;
+  tempWindow.add(temp);
+  humidityWindow.add(humidity);
+  
+  // currentConditions() only changes, and so a delta only goes out, when a
+  // value moves past its deadband or the heartbeat is due
+  unsigned long now = millis();
+  tempReport.update(temp, now);
+  humidityReport.update(humidity, now);
+}
+
+void encoderISR() {
+  uint8_t state = (digitalRead(ENCODER_CLK) << 1) | digitalRead(ENCODER_DT);
+  int8_t step = encoderTable[(encoderState << 2) | state];
+  encoderState = state;
+  if (step == 0) {
+    return;
+  }
   
-  if (!isnan(h) && !isnan(t)) {
-    roomTemp = t;
-    roomHumidity = h;
+  // Only a run of steps in one direction accelerates, so bounce stays 1x
+  uint32_t now = micros();
+  uint32_t interval = now - encoderLastStep;
+  int8_t weight = 1;
+  if (step == encoderLastDir) {
+    if (interval < encoderFastStep) {
+      weight = 4;
+    } else if (interval < encoderMediumStep) {
+      weight = 2;
+    }
   }
+  encoderLastStep = now;
+  encoderLastDir = step;
+  
+  encoderPos += step;
+  encoderAccelPos += step * weight;
 }
 
 void handleEncoder() {
-  // Read encoder pins
-  bool encoderClk = digitalRead(ENCODER_CLK);
-  bool encoderDt = digitalRead(ENCODER_DT);
-  
-  // Detect rotation
-  if (encoderClk != encoderClkLast) {
-    if (encoderDt != encoderClk) {
-      encoderPos++;  // Clockwise
-    } else {
-      encoderPos--;  // Counter-clockwise
-    }
-    encoderClkLast = encoderClk;
-  }
+  // Steps accumulate in the ISR however long the rest of loop() takes
+  int32_t pos = encoderPos;
+  int32_t accelPos = encoderAccelPos;
   
   // Check if position changed
-  if (encoderPos != lastEncoderPos) {
-    int delta = encoderPos - lastEncoderPos;
-    lastEncoderPos = encoderPos;
+  if (pos != lastEncoderPos) {
+    int delta = pos - lastEncoderPos;
+    int accelDelta = accelPos - lastEncoderAccelPos;
+    lastEncoderPos = pos;
+    lastEncoderAccelPos = accelPos;
+    if (wakeOnInput()) {
+      return;
+    }
     
     if (menuState == MENU_BROWSE) {
       // Browse between windows
@@ -263,32 +593,28 @@ void handleEncoder() {
       }
     } else if (menuState == MENU_EDIT) {
       // Edit the selected setting
+      markLocalChange();
       switch (currentWindow) {
         case WINDOW_TEMP:
-          hvacSettings.setTemp += delta;
-          if (hvacSettings.setTemp > 30) hvacSettings.setTemp = 30;
-          if (hvacSettings.setTemp < 16) hvacSettings.setTemp = 16;
+          hvacSettings.setTemp = clampSetTemp(hvacSettings.setTemp + delta);
           break;
           
         case WINDOW_FAN:
           if (delta != 0) {
-            if (hvacSettings.fanSpeed == "low") hvacSettings.fanSpeed = "medium";
-            else if (hvacSettings.fanSpeed == "medium") hvacSettings.fanSpeed = "high";
-            else if (hvacSettings.fanSpeed == "high") hvacSettings.fanSpeed = "auto";
-            else hvacSettings.fanSpeed = "low";
+            // Cycles low -> medium -> high -> auto -> low
+            hvacSettings.fanSpeed = (hvacSettings.fanSpeed + 1) % FAN_COUNT;
           }
           break;
           
         case WINDOW_SWING:
           if (delta != 0) {
-            hvacSettings.swing = (hvacSettings.swing == "on") ? "off" : "on";
+            hvacSettings.swing = !hvacSettings.swing;
           }
           break;
           
         case WINDOW_TIMER:
-          hvacSettings.timer += delta * 15;  // 15-minute increments
-          if (hvacSettings.timer < 0) hvacSettings.timer = 0;
-          if (hvacSettings.timer > 720) hvacSettings.timer = 720;
+          // 15-minute increments, bigger jumps on a fast spin
+          hvacSettings.timer = clampTimer(hvacSettings.timer + accelDelta * 15);
           break;
       }
     }
@@ -300,6 +626,9 @@ void handleButtons() {
   if (digitalRead(ENCODER_SW) == LOW) {
     if (millis() - lastEncoderPress > debounceDelay) {
       lastEncoderPress = millis();
+      if (wakeOnInput()) {
+        return;
+      }
       
       if (menuState == MENU_BROWSE) {
         // Enter edit mode for highlighted window
@@ -316,215 +645,558 @@ void handleButtons() {
   if (digitalRead(POWER_BTN) == LOW) {
     if (millis() - lastPowerPress > debounceDelay) {
       lastPowerPress = millis();
-      hvacSettings.power = (hvacSettings.power == "on") ? "off" : "on";
+      if (wakeOnInput()) {
+        return;
+      }
+      hvacSettings.power = !hvacSettings.power;
+      markLocalChange();
+    }
+  }
+}
+
+// Restarts the idle timeout; true if the panels were blank, so the input
+// should only wake them
+bool wakeOnInput() {
+  lastInput = millis();
+  bool wasBlank = displayIdle == DISPLAY_BLANK;
+  setDisplayIdle(DISPLAY_AWAKE);
+  return wasBlank;
+}
+
+// Starts the knob_to_link latency span (kept from the first change of a burst)
+void markLocalChange() {
+  if (!localChangePending) {
+    localChangeAt = micros();
+    localChangePending = true;
+  }
+}
+
+void serviceDebugSerial() {
+  while (Serial.available() > 0) {
+    char c = (char)Serial.read();
+    if (c == '\n' || c == '\r') {
+      if (debugLineLen > 0) {
+        debugLine[debugLineLen] = '\0';
+        handleDebugCommand(debugLine);
+        debugLineLen = 0;
+      }
+    } else if (debugLineLen < sizeof(debugLine) - 1) {
+      debugLine[debugLineLen++] = c;
+    }
+  }
+}
+
+void handleDebugCommand(const char* cmd) {
+  if (strcmp(cmd, "prof") == 0) {
+    printProfile(Serial, profSpans, sizeof(profSpans) / sizeof(profSpans[0]),
+                 scheduler.tasks, scheduler.count);
+  } else if (strcmp(cmd, "prof reset") == 0) {
+    for (ProfileSpan* span : profSpans) {
+      span->reset();
     }
+    scheduler.resetStats();
+    memLoop.reset();
+    Serial.println("Profile reset");
+  } else if (strcmp(cmd, "mem") == 0) {
+    char line[96];
+    memSample().format(line, sizeof(line));
+    Serial.println(line);
+  } else if (strcmp(cmd, "link") == 0) {
+    char line[128];
+    linkBaud.format(line, sizeof(line), linkErrors());
+    Serial.println(line);
   }
 }
 
+// Linker script bounds of the heap and main stack; weak so a core whose
+// script names them differently still links (they read as address 0)
+extern "C" {
+extern uint32_t __HeapLimit __attribute__((weak));
+extern uint32_t __StackLimit __attribute__((weak));
+}
+
+void paintStack() {
+  // Paint from the bottom of the stack up to just below this frame, so
+  // memSample() can find how deep it has ever grown
+  if (&__StackLimit == nullptr) return;
+  uint32_t here;
+  uint32_t* top = &here - 16;
+  memPaintStack(&__StackLimit, top);
+}
+
+MemStats memSample() {
+  MemStats m;
+  struct mallinfo mi = mallinfo();
+  
+  // Free heap: chunks free inside malloc's arena plus the part of the heap
+  // region it hasn't claimed yet
+  uint32_t untouched = 0;
+  if (&__HeapLimit != nullptr) {
+    char* brk = (char*)sbrk(0);
+    if (brk < (char*)&__HeapLimit) untouched = (char*)&__HeapLimit - brk;
+  }
+  m.freeHeap = (uint32_t)mi.fordblks + untouched;
+  
+  // newlib doesn't report its largest free chunk; the top chunk plus the
+  // unclaimed region is one contiguous block, so use that as a lower bound
+  m.maxFreeBlock = (uint32_t)mi.keepcost + untouched;
+  m.fragmentation = memFragmentation(m.freeHeap, m.maxFreeBlock);
+  
+  if (&__StackLimit != nullptr) {
+    uint32_t here;
+    m.stackFree = memUnpaintedStack(&__StackLimit, &here);
+  }
+  m.setCounts(memLoop);
+  return m;
+}
+
+void sendMemToESP() {
+  if (!linkBinary) {
+    return;   // JSON peers don't know the message
+  }
+  uint8_t payload[LINK_MEM_SIZE];
+  linkPutMem(payload, memSample());
+  sendLinkFrame(LINK_MSG_MEM, payload, sizeof(payload));
+}
+
+void updateDisplays() {
+  serviceDisplayIdle();
+  
+  // Blank panels keep their RAM and the shadows still match it, so drawing
+  // can wait until they wake
+  if (displayIdle != DISPLAY_BLANK) {
+    updateDisplay1();
+    updateDisplay2();
+    displaysInvalid = false;
+  }
+  
+  // Tell the ESP its last settings message is on screen now
+  if (ackPending && linkBinary) {
+    sendLinkFrame(LINK_MSG_ACK, &ackSeq, 1);
+  }
+  ackPending = false;
+}
+
+void serviceDisplayIdle() {
+  unsigned long idle = millis() - lastInput;
+  if (idle >= displayBlankTimeout) {
+    setDisplayIdle(DISPLAY_BLANK);
+  } else if (idle >= displayDimTimeout && displayIdle == DISPLAY_AWAKE) {
+    setDisplayIdle(DISPLAY_DIM);
+  }
+}
+
+void setDisplayIdle(DisplayIdle state) {
+  if (state == displayIdle) {
+    return;
+  }
+  uint8_t powerSave = state == DISPLAY_BLANK ? 1 : 0;
+  uint8_t contrast = state == DISPLAY_AWAKE ? displayContrast : displayDimContrast;
+  display1.setPowerSave(powerSave);
+  display2.setPowerSave(powerSave);
+  display1.setContrast(contrast);
+  display2.setContrast(contrast);
+  displayIdle = state;
+}
+
 void updateDisplay1() {
-  // Display 1: Room Conditions
+  // Display 1: Room Conditions. Readings only change at display resolution
+  // every few seconds.
+  bool tempChanged = false;
+  bool humidityChanged = false;
+  char text[10];
+  
+  int32_t tenths = lroundf(roomTemp * 10);
+  if (shownRoom.temp.changed(tenths)) {
+    int32_t a = tenths < 0 ? -tenths : tenths;
+    snprintf(text, sizeof(text), "%s%ld.%ldC", tenths < 0 ? "-" : "", (long)(a / 10),
+             (long)(a % 10));
+    shownRoom.temp.set(text, 45);
+    tempChanged = true;
+  }
+  int32_t percent = lroundf(roomHumidity);
+  if (shownRoom.humidity.changed(percent)) {
+    snprintf(text, sizeof(text), "%ld%%", (long)percent);
+    shownRoom.humidity.set(text, 65);
+    humidityChanged = true;
+  }
+  
+  if (!displaysInvalid && !tempChanged && !humidityChanged) {
+    return;
+  }
+  ProfileScope scope(profDisplay1);
+  
   display1.clearBuffer();
   
-  // Title
+  // Title, line under it, and labels
   display1.setFont(u8g2_font_6x10_tr);
   display1.drawStr(15, 10, "Room Condition");
-  
-  // Draw line under title
   display1.drawLine(0, 12, 128, 12);
-  
-  // Temperature label
-  display1.setFont(u8g2_font_6x10_tr);
   display1.drawStr(5, 26, "Temp:");
-  
-  // Temperature value (larger font)
-  display1.setFont(u8g2_font_10x20_tr);
-  char tempStr[10];
-  dtostrf(roomTemp, 4, 1, tempStr);
-  strcat(tempStr, "C");
-  display1.drawStr(45, 30, tempStr);
-  
-  // Humidity label
-  display1.setFont(u8g2_font_6x10_tr);
   display1.drawStr(5, 48, "Humidity:");
   
-  // Humidity value (larger font)
+  // Values (larger font)
   display1.setFont(u8g2_font_10x20_tr);
-  char humStr[10];
-  sprintf(humStr, "%.0f%%", roomHumidity);
-  display1.drawStr(65, 52, humStr);
+  display1.drawStr(shownRoom.temp.x, 30, shownRoom.temp.text);
+  display1.drawStr(shownRoom.humidity.x, 52, shownRoom.humidity.text);
   
-  display1.sendBuffer();
+  flushDisplay(display1, display1Shadow);
 }
 
 void updateDisplay2() {
   // Display 2: AC Settings
-  display2.clearBuffer();
+  SettingsView view;
+  view.settings = hvacSettings;
+  view.menuState = menuState;
+  view.highlighted = highlightedWindow;
+  view.current = currentWindow;
+  
+  if (!displaysInvalid && view.settings == shownSettings.settings &&
+      view.menuState == shownSettings.menuState &&
+      view.highlighted == shownSettings.highlighted &&
+      view.current == shownSettings.current) {
+    return;
+  }
+  shownSettings = view;
+  ProfileScope scope(profDisplay2);
+  updateWindowText();
   
-  // Title
-  display2.setFont(u8g2_font_6x10_tr);
-  char titleStr[30];
-  sprintf(titleStr, "AC Settings [%s]", hvacSettings.power == "on" ? "ON" : "OFF");
-  display2.drawStr(5, 10, titleStr);
+  display2.clearBuffer();
   
-  // Draw line under title
-  display2.drawLine(0, 12, 128, 12);
+  // Frames first, then all titles and all text in one font each
+  bool selected[WINDOW_COUNT];
+  for (uint8_t w = 0; w < WINDOW_COUNT; w++) {
+    selected[w] = menuState == MENU_EDIT && currentWindow == w;
+    drawWindow(display2, kWindowLayout[w], highlightedWindow == w, selected[w]);
+  }
   
-  // Define window positions and sizes
-  int leftX = 2, rightX = 66;
-  int topY = 16, bottomY = 42;
-  int leftW = 60, rightW = 60;
-  int windowH = 24;
-  
-  // Temperature (Top Left)
-  char tempStr[8];
-  sprintf(tempStr, "%dC", hvacSettings.setTemp);
-  drawWindow(display2, leftX, topY, leftW, windowH, "TEMP", tempStr,
-             highlightedWindow == WINDOW_TEMP, 
-             menuState == MENU_EDIT && currentWindow == WINDOW_TEMP);
-  
-  // Fan Speed (Top Right)
-  const char* fanStr = hvacSettings.fanSpeed == "low" ? "LOW" :
-                       hvacSettings.fanSpeed == "medium" ? "MED" :
-                       hvacSettings.fanSpeed == "high" ? "HIGH" : "AUTO";
-  drawWindow(display2, rightX, topY, rightW, windowH, "FAN", fanStr,
-             highlightedWindow == WINDOW_FAN,
-             menuState == MENU_EDIT && currentWindow == WINDOW_FAN);
-  
-  // Timer (Bottom Left)
-  char timerStr[8];
-  if (hvacSettings.timer == 0) {
-    sprintf(timerStr, "OFF");
-  } else {
-    sprintf(timerStr, "%dm", hvacSettings.timer);
+  // Window titles (small, top); dark on the filled window being edited
+  display2.setFont(u8g2_font_5x7_tr);
+  for (uint8_t w = 0; w < WINDOW_COUNT; w++) {
+    const WindowLayout& window = kWindowLayout[w];
+    display2.setDrawColor(selected[w] ? 0 : 1);
+    display2.drawStr(window.titleX, window.y + WINDOW_TITLE_Y, window.title);
   }
-  drawWindow(display2, leftX, bottomY, leftW, windowH, "TIMER", timerStr,
-             highlightedWindow == WINDOW_TIMER,
-             menuState == MENU_EDIT && currentWindow == WINDOW_TIMER);
   
-  // Swing (Bottom Right)
-  const char* swingStr = hvacSettings.swing == "on" ? "ON" : "OFF";
-  drawWindow(display2, rightX, bottomY, rightW, windowH, "SWING", swingStr,
-             highlightedWindow == WINDOW_SWING,
-             menuState == MENU_EDIT && currentWindow == WINDOW_SWING);
+  // Screen title, line under it, and window values (centered)
+  display2.setFont(u8g2_font_6x10_tr);
+  display2.setDrawColor(1);
+  display2.drawStr(5, 10, kSettingsTitles[hvacSettings.power ? 1 : 0]);
+  display2.drawLine(0, 12, 128, 12);
+  for (uint8_t w = 0; w < WINDOW_COUNT; w++) {
+    display2.setDrawColor(selected[w] ? 0 : 1);
+    display2.drawStr(windowText[w].x, kWindowLayout[w].y + WINDOW_VALUE_Y, windowText[w].text);
+  }
+  display2.setDrawColor(1);
   
-  display2.sendBuffer();
+  flushDisplay(display2, display2Shadow);
+}
+
+// Reformats a window's value only when its setting changed
+void updateWindowText() {
+  auto place = [](SettingWindow w, const char* text) {
+    windowText[w].set(text, kWindowLayout[w].x, kWindowLayout[w].w, FONT_MEDIUM_WIDTH);
+  };
+  char text[8];
+  
+  if (windowText[WINDOW_TEMP].changed(hvacSettings.setTemp)) {
+    snprintf(text, sizeof(text), "%uC", hvacSettings.setTemp);
+    place(WINDOW_TEMP, text);
+  }
+  if (windowText[WINDOW_FAN].changed(hvacSettings.fanSpeed)) {
+    place(WINDOW_FAN, fanLabel(hvacSettings.fanSpeed));
+  }
+  if (windowText[WINDOW_SWING].changed(hvacSettings.swing)) {
+    place(WINDOW_SWING, onOffLabel(hvacSettings.swing));
+  }
+  if (windowText[WINDOW_TIMER].changed(hvacSettings.timer)) {
+    if (hvacSettings.timer == 0) {
+      place(WINDOW_TIMER, "OFF");
+    } else {
+      snprintf(text, sizeof(text), "%um", hvacSettings.timer);
+      place(WINDOW_TIMER, text);
+    }
+  }
+}
+
+// Sends only the tile rows that differ from the last frame, and only the
+// span of tiles within each row that changed
+void flushDisplay(U8G2 &u8g2, uint8_t* shadow) {
+  uint8_t* buffer = u8g2.getBufferPtr();
+  
+  for (uint8_t ty = 0; ty < OLED_TILE_HEIGHT; ty++) {
+    uint8_t* row = buffer + ty * OLED_ROW_BYTES;
+    uint8_t* shown = shadow + ty * OLED_ROW_BYTES;
+    
+    int first = -1;
+    int last = -1;
+    for (int i = 0; i < OLED_ROW_BYTES; i++) {
+      if (row[i] != shown[i]) {
+        if (first < 0) first = i;
+        last = i;
+      }
+    }
+    if (first < 0) {
+      continue;
+    }
+    
+    uint8_t tx = first / 8;
+    uint8_t tw = last / 8 - tx + 1;
+    u8g2.updateDisplayArea(tx, ty, tw, 1);
+    memcpy(shown + tx * 8, row + tx * 8, tw * 8);
+  }
 }
 
-void drawWindow(U8G2 &u8g2, int x, int y, int w, int h,
-                const char* title, const char* value, bool highlighted, bool selected) {
+// Window background only; updateDisplay2() draws the text over it
+void drawWindow(U8G2 &u8g2, const WindowLayout& window, bool highlighted, bool selected) {
+  int x = window.x, y = window.y, w = window.w, h = window.h;
+  u8g2.setDrawColor(1);
   
   if (selected) {
-    // Filled background for selected (editing mode) - bright background, dark text
-    u8g2.setDrawColor(1);  // White
+    // Filled background for selected (editing mode) - text is drawn dark on it
     u8g2.drawBox(x, y, w, h);
-    u8g2.setDrawColor(0);  // Black for text
-    
-    // Draw title (small, top)
-    u8g2.setFont(u8g2_font_5x7_tr);
-    int titleLen = u8g2.getStrWidth(title);
-    u8g2.drawStr(x + (w - titleLen) / 2, y + 9, title);
-    
-    // Draw value (centered)
-    u8g2.setFont(u8g2_font_6x10_tr);
-    int valueLen = u8g2.getStrWidth(value);
-    u8g2.drawStr(x + (w - valueLen) / 2, y + 20, value);
-    
-    // Reset draw color
-    u8g2.setDrawColor(1);
-    
   } else if (highlighted) {
     // Thicker border for highlighted (menu mode) - 3 pixel thick border
-    u8g2.setDrawColor(1);
     u8g2.drawFrame(x, y, w, h);
     u8g2.drawFrame(x+1, y+1, w-2, h-2);
     u8g2.drawFrame(x+2, y+2, w-4, h-4);
-    
-    // Draw title (small, top)
-    u8g2.setFont(u8g2_font_5x7_tr);
-    int titleLen = u8g2.getStrWidth(title);
-    u8g2.drawStr(x + (w - titleLen) / 2, y + 9, title);
-    
-    // Draw value (centered)
-    u8g2.setFont(u8g2_font_6x10_tr);
-    int valueLen = u8g2.getStrWidth(value);
-    u8g2.drawStr(x + (w - valueLen) / 2, y + 20, value);
-    
   } else {
     // Normal border - single line
-    u8g2.setDrawColor(1);
     u8g2.drawFrame(x, y, w, h);
-    
-    // Draw title (small, top)
-    u8g2.setFont(u8g2_font_5x7_tr);
-    int titleLen = u8g2.getStrWidth(title);
-    u8g2.drawStr(x + (w - titleLen) / 2, y + 9, title);
-    
-    // Draw value (centered)
-    u8g2.setFont(u8g2_font_6x10_tr);
-    int valueLen = u8g2.getStrWidth(value);
-    u8g2.drawStr(x + (w - valueLen) / 2, y + 20, value);
   }
 }
 
+LinkConditions currentConditions() {
+  LinkConditions conditions;
+  conditions.temp = tempReport.reported;
+  conditions.humidity = (uint16_t)humidityReport.reported;
+  return conditions;
+}
+
 void sendDataToESP() {
-  // Create JSON document
-  StaticJsonDocument<512> doc;
+  unsigned long now = millis();
+  serviceLinkBaud();
+  
+  // Peer hasn't answered our HELLO yet, keep offering the binary protocol
+  if (!linkBinary && now - lastHelloSend >= helloInterval) {
+    sendLinkHello();
+  }
   
-  doc["roomTemp"] = roomTemp;
-  doc["roomHumidity"] = roomHumidity;
+  LinkConditions conditions = currentConditions();
+  uint8_t mask = settingsDiff(hvacSettings, sentSettings);
+  if (conditions.temp != sentConditions.temp || conditions.humidity != sentConditions.humidity) {
+    mask |= LINK_DELTA_CONDITIONS;
+  }
+  
+  bool keyframe = keyframeRequested || now - lastKeyframeSend >= keyframeInterval;
+  if (!keyframe && (mask == 0 || now - lastDataSend < deltaMinGap)) {
+    return;  // Nothing new, or still coalescing a burst of changes
+  }
+  ProfileScope scope(profLinkTx);
   
-  JsonObject hvac = doc.createNestedObject("hvac");
-  hvac["power"] = hvacSettings.power;
-  hvac["setTemp"] = hvacSettings.setTemp;
-  hvac["mode"] = hvacSettings.mode;
-  hvac["fanSpeed"] = hvacSettings.fanSpeed;
-  hvac["timer"] = hvacSettings.timer;
-  hvac["swing"] = hvacSettings.swing;
+  if (linkBinary) {
+    uint8_t payload[LINK_MAX_PAYLOAD];
+    uint8_t len;
+    uint8_t type;
+    
+    if (keyframe) {
+      linkPutConditions(payload, conditions);
+      linkPutSettings(payload + LINK_CONDITIONS_SIZE, hvacSettings);
+      payload[LINK_CONDITIONS_SIZE + LINK_SETTINGS_SIZE] = linkTxSeq;
+      len = LINK_CONDITIONS_SIZE + LINK_SETTINGS_SIZE + 1;
+      
+      // Min/mean/max since the last keyframe
+      if (tempWindow.count > 0) {
+        linkPutWindow(payload + len, tempWindow, humidityWindow);
+        len += LINK_WINDOW_SIZE;
+      }
+      type = LINK_MSG_STATE;
+    } else {
+      len = linkPutDelta(payload, linkTxSeq, mask, hvacSettings, conditions);
+      type = LINK_MSG_DELTA;
+    }
+    sendLinkFrame(type, payload, len);
+    
+    Serial.print(keyframe ? "-> ESP: [keyframe " : "-> ESP: [delta ");
+    Serial.print(len + LINK_HEADER_SIZE + LINK_CRC_SIZE);
+    Serial.println(" B]");
+  } else {
+    // JSON fallback always carries the full state
+    StaticJsonDocument<512> doc;
+    
+    doc["roomTemp"] = conditions.temp / 100.0f;
+    doc["roomHumidity"] = conditions.humidity / 100.0f;
+    
+    JsonObject hvac = doc.createNestedObject("hvac");
+    writeSettingsJson(hvac, hvacSettings, kLinkJsonKeys);
+    
+    // Send via Software Serial
+    serializeJson(doc, Serial1);
+    Serial1.println();
+    
+    // Also debug via USB Serial
+    Serial.print("-> ESP: ");
+    serializeJson(doc, Serial);
+    Serial.println();
+  }
   
-  // Send via Software Serial
-  serializeJson(doc, Serial1);
-  Serial1.println();
+  linkTxSeq++;
+  sentSettings = hvacSettings;
+  sentConditions = conditions;
+  lastDataSend = now;
+  if (keyframe) {
+    lastKeyframeSend = now;
+    keyframeRequested = false;
+    tempWindow.reset();
+    humidityWindow.reset();
+  }
   
-  // Also debug via USB Serial
-  Serial.print("-> ESP: ");
-  serializeJson(doc, Serial);
-  Serial.println();
+  if (localChangePending) {
+    profKnobToLink.record(micros() - localChangeAt);
+    localChangePending = false;
+  }
+}
+
+void sendLinkFrame(uint8_t type, const uint8_t* payload, uint8_t len) {
+  uint8_t frame[LINK_MAX_FRAME];
+  size_t frameLen = linkEncodeFrame(type, payload, len, frame);
+  Serial1.write(frame, frameLen);
+  linkBaud.sent(millis());
 }
 
 void receiveDataFromESP() {
-  if (Serial1.available() > 0) {
-    String jsonString = Serial1.readStringUntil('\n');
-    
-    Serial.print("<- ESP: ");
-    Serial.println(jsonString);
+  // Drain whatever has arrived without waiting for the rest of a message
+  while (Serial1.available() > 0 && !linkRx.full()) {
+    linkRx.write((uint8_t)Serial1.read());
+  }
+  
+  LinkRxEvent event;
+  while ((event = linkRx.poll()) != LINK_RX_NONE) {
+    if (event == LINK_RX_FRAME) {
+      handleLinkFrame();
+    } else {
+      handleJsonLine(linkRx.line);
+    }
+  }
+}
+
+void handleJsonLine(char* line) {
+  Serial.print("<- ESP: ");
+  Serial.println(line);
+  
+  // Parse in place (zero-copy) from the receive line buffer
+  StaticJsonDocument<512> doc;
+  DeserializationError error = deserializeJson(doc, line);
+  
+  if (!error) {
+    // Peer is speaking JSON, so fall back to JSON ourselves
+    linkBinary = false;
     
-    StaticJsonDocument<512> doc;
-    DeserializationError error = deserializeJson(doc, jsonString);
+    if (doc.containsKey("hvac")) {
+      readSettingsJson(doc["hvac"], hvacSettings, kLinkJsonKeys);
+      // The ESP already has these values, don't echo them back
+      sentSettings = hvacSettings;
+    }
+  }
+}
+
+void sendLinkHello() {
+  uint8_t payload[1] = { LINK_VERSION };
+  sendLinkFrame(LINK_MSG_HELLO, payload, sizeof(payload));
+  lastHelloSend = millis();
+}
+
+void handleLinkFrame() {
+  // Any valid frame proves the ESP speaks the binary protocol
+  bool wasBinary = linkBinary;
+  linkBinary = true;
+  linkBaud.heard(millis());
+  
+  const LinkFrameParser& frame = linkRx.frame;
+  
+  switch (frame.type) {
+    case LINK_MSG_HELLO:
+      Serial.println("<- ESP: HELLO (binary link enabled)");
+      if (!wasBinary) {
+        sendLinkHello();
+        keyframeRequested = true;
+      }
+      break;
+      
+    case LINK_MSG_SETTINGS: {
+      if (frame.len < LINK_SETTINGS_SIZE + 1) break;
+      Serial.println("<- ESP: [settings keyframe]");
+      linkGetSettings(frame.payload, hvacSettings);
+      linkRxSeq.keyframe(frame.payload[LINK_SETTINGS_SIZE]);
+      // The ESP already has these values, don't echo them back
+      sentSettings = hvacSettings;
+      ackSeq = frame.payload[LINK_SETTINGS_SIZE];
+      ackPending = true;
+      break;
+    }
     
-    if (!error) {
-      if (doc.containsKey("hvac")) {
-        JsonObject hvac = doc["hvac"];
-        
-        if (hvac.containsKey("power")) {
-          hvacSettings.power = hvac["power"].as<String>();
-        }
-        if (hvac.containsKey("setTemp")) {
-          hvacSettings.setTemp = hvac["setTemp"];
-        }
-        if (hvac.containsKey("mode")) {
-          hvacSettings.mode = hvac["mode"].as<String>();
-        }
-        if (hvac.containsKey("fanSpeed")) {
-          hvacSettings.fanSpeed = hvac["fanSpeed"].as<String>();
-        }
-        if (hvac.containsKey("timer")) {
-          hvacSettings.timer = hvac["timer"];
-        }
-        if (hvac.containsKey("swing")) {
-          hvacSettings.swing = hvac["swing"].as<String>();
-        }
+    case LINK_MSG_DELTA: {
+      uint8_t seq, mask;
+      HVACSettings incoming = hvacSettings;
+      LinkConditions unused;
+      if (!linkGetDelta(frame.payload, frame.len, seq, mask, incoming, unused)) break;
+      
+      Serial.println("<- ESP: [settings delta]");
+      applySettingsFields(hvacSettings, incoming, mask & FIELD_ALL);
+      applySettingsFields(sentSettings, incoming, mask & FIELD_ALL);
+      ackSeq = seq;
+      ackPending = true;
+      
+      // A lost delta may have left other fields stale
+      if (!linkRxSeq.delta(seq)) {
+        sendLinkFrame(LINK_MSG_SYNC_REQ, nullptr, 0);
       }
+      break;
     }
+    
+    case LINK_MSG_SYNC_REQ:
+      keyframeRequested = true;
+      break;
+    
+    case LINK_MSG_BAUD:
+      applyLinkBaud(linkBaud.onBaud(frame.payload, frame.len, millis()));
+      break;
+    
+    case LINK_MSG_PROBE:
+      applyLinkBaud(linkBaud.onProbe(frame.payload, frame.len, millis()));
+      break;
+    
+    default:
+      break;
+  }
+}
+
+LinkErrors linkErrors() {
+  LinkErrors e;
+  e.crc = linkRx.frame.crcErrors;
+  e.overruns = linkRx.ringOverruns;
+  e.gaps = linkRxSeq.gaps;
+  return e;
+}
+
+void serviceLinkBaud() {
+  applyLinkBaud(linkBaud.poll(millis(), linkErrors().total()));
+}
+
+void applyLinkBaud(uint8_t actions) {
+  if (actions & LINK_BAUD_SEND) {
+    sendLinkFrame(linkBaud.outType, linkBaud.out, linkBaud.outLen);
+  }
+  if (actions & LINK_BAUD_SWITCH) {
+    // Let the reply leave at the old rate before reopening the UART
+    Serial1.flush();
+    Serial1.end();
+    Serial1.begin(linkBaud.baud());
+    linkRx.frame.reset();
+    keyframeRequested = true;  // Resync whatever a bad rate may have lost
+    Serial.print("Link now at ");
+    Serial.print(linkBaud.baud());
+    Serial.println(" baud");
   }
 }
 
@@ -554,524 +1226,1847 @@ void receiveDataFromESP() {
  *   RX: RX (GPIO3)
  *   TX: TX (GPIO1)
  *   GND: GND
+ * 
+ * Firmware updates come from the server over WiFi (see serviceOta()); USB
+ * is only needed for the first flash.
+ * 
+ * - Debug log (optional, TX only): D4 (GPIO2) at 115200 baud to a
+ *   USB-serial adapter's RX, GND to GND
  */
 
 #include <ESP8266WiFi.h>
 #include <ESP8266HTTPClient.h>
+#ifdef TELEMETRY_SPILL_LITTLEFS
+#include <LittleFS.h>
+#endif
+#include <time.h>
+#include <Updater.h>
+#include <BearSSLHelpers.h>
+#if __has_include("ota_public_key.h")
+#include "ota_public_key.h"   // otaPublicKey, from server/sign_firmware.py keygen
+#define OTA_SIGNED_UPDATES 1
+#else
+#define OTA_SIGNED_UPDATES 0  // No key to check images against: offers are refused
+#endif
+#ifdef HUB_ARDUINO_OTA
+#include <ArduinoOTA.h>
+static_assert(sizeof(HUB_OTA_PASSWORD) > 1, "Set HUB_OTA_PASSWORD for the ArduinoOTA build");
+#endif
 #include <IRremoteESP8266.h>
 #include <IRsend.h>
-#include <ir_Daikin.h>  // Change this based on your AC brand
+#include "ac_backend.h"  // AC brand is selected with AC_PROTOCOL in platformio.ini
+#include "hub_log.h"     // Log level is selected with LOG_LEVEL in platformio.ini
 
 // WiFi credentials
 const char* ssid = "Anshul_2";
 const char* password = "mudit@00012";
 
+// Device ID: the server keeps separate state per hub, so give each room its
+// own (letters, digits, - or _), e.g. build_flags = -D DEVICE_ID=\"bedroom\"
+#ifndef DEVICE_ID
+#define DEVICE_ID "default"
+#endif
+#define DEVICE_QUERY "?device=" DEVICE_ID
+
 // Server URL (replace with your computer's IP address)
-const char* serverUrl = "http://192.168.29.64:5001/api/data";
-const char* commandUrl = "http://192.168.29.64:5001/api/hvac/command";
-const char* updateUrl = "http://192.168.29.64:5001/api/hvac/update";
+const char* serverUrl = "http://192.168.29.64:5001/api/data" DEVICE_QUERY;
+const char* commandUrl = "http://192.168.29.64:5001/api/hvac/command" DEVICE_QUERY;
+const char* updateUrl = "http://192.168.29.64:5001/api/hvac/update" DEVICE_QUERY;
+const char* scheduleSlotsUrl = "http://192.168.29.64:5001/api/schedule/slots" DEVICE_QUERY;
+const char* batchUrl = "http://192.168.29.64:5001/api/data/batch" DEVICE_QUERY;
+const char* firmwareUrl = "http://192.168.29.64:5001/api/firmware/";  // + AC variant
+
+// Push channel (long-poll) endpoint, same server as above
+const char* serverHost = "192.168.29.64";
+const uint16_t serverPort = 5001;
+const char* commandWaitPath = "/api/hvac/command/wait" DEVICE_QUERY;
+
+// Hub clock for the local schedule
+const char* ntpServer = "pool.ntp.org";
+
+// Debug output: Serial is the link to the Arduino, so logs and debug command
+// replies go out on UART1's TX (GPIO2) instead. Debug commands (prof, tstat,
+// link, ota, mem, log) are typed on the link's Serial, so they are only
+// compiled in with -D HUB_SERIAL_COMMANDS; a production link carries
+// protocol traffic only, and the same reports reach the server in keyframes
+// (/api/profile, /api/memory, /api/devices). HUB_DEBUG_UART is 0 when
+// neither commands nor logging (-D LOG_LEVEL=LOG_LEVEL_NONE) are built in:
+// Serial1 is never started and nothing writes to it.
+#if LOG_LEVEL > LOG_LEVEL_NONE || defined(HUB_SERIAL_COMMANDS)
+#define HUB_DEBUG_UART 1
+#else
+#define HUB_DEBUG_UART 0
+#endif
+#define LOG_BAUD 115200
+HardwareSerial& logSerial = Serial1;
+#if LOG_LEVEL > LOG_LEVEL_NONE
+LogRing logRing;           // Last LOG_RING_SIZE records, dumped with "log"
+LogLimiter logLimiter;     // Keeps a burst from blocking loop() on the UART
+#endif
 
 // IR Transmitter setup
 const uint16_t kIrLed = 4;  // GPIO4 (D2)
-IRDaikinESP ac(kIrLed);     // Change to your AC brand (IRDaikinESP, IRMitsubishiAC, etc.)
+AcBackend::Ac ac(kIrLed);   // Protocol class chosen at compile time (see ac_backend.h)
+IRsend irsend(kIrLed);      // Replays cached states without re-encoding
 
-WiFiClient wifiClient;
+// Encoded IR states keyed by settings, so repeat states skip protocol encoding.
+// The timer is handled by the hub, not sent over IR, so it isn't part of the key.
+#define IR_CACHE_FIELDS  (FIELD_ALL & ~FIELD_TIMER)
+struct IrFrame {
+  uint8_t state[AcBackend::kStateLength];
+};
+LruCache<IrFrame, 8> irCache;
 
-// HVAC Settings
-struct HVACSettings {
-  String power = "on";
-  int setTemp = 24;
-  String mode = "cool";
-  String fanSpeed = "medium";
-  int timer = 0;
-  String swing = "on";
-  String source = "arduino";  // Track where change came from
-} hvacSettings;
+// IR send coalescing: a burst of changes collapses into one send of the latest state
+bool acPending = false;
+unsigned long acFirstChange = 0;
+unsigned long acLastChange = 0;
+HVACSettings irSentSettings;
+bool irSentValid = false;
+const unsigned long irMaxDelay = 1000;  // Send at the latest this long after the first (window: hvac_timing.h)
 
-// Room conditions from Arduino
-float roomTemp = 0.0;
+// Closed-loop control (see thermostat.h): cycles the AC and corrects its
+// setpoint against the room temperature the Arduino measures.
+// Build with -D THERMOSTAT_ENABLED=0 to leave regulation to the AC.
+#ifndef THERMOSTAT_ENABLED
+#define THERMOSTAT_ENABLED 1
+#endif
+const ThermostatConfig thermostatConfig = {
+  50,        // Cycle power 0.5 C either side of the setpoint
+  256,       // 1 C of AC setpoint offset per C of error
+  109,       // Integral time ~10 minutes (65536 / 600)
+  300,       // AC setpoint stays within 3 C of the user's
+  100, 200,  // Auto fan: medium from 1 C of error, high from 2 C
+  180000,    // Compressor runs at least 3 minutes...
+  180000     // ...and rests at least 3 minutes
+};
+Thermostat thermostat(thermostatConfig);
+bool thermostatEnabled = THERMOSTAT_ENABLED;
+unsigned long lastThermostatSend = 0;
+bool thermostatSent = false;
+const unsigned long thermostatInterval = 5000;       // Control step every 5 seconds
+const unsigned long thermostatMinSendGap = 60000;    // At most one thermostat IR send a minute
+const unsigned long thermostatStaleAfter = 120000;   // No reading this long: hand control back
+
+// WiFi connection manager: attempts never block; SDK events report the
+// result and failed attempts back off exponentially
+enum WifiState : uint8_t {
+  WIFI_WAITING,     // Offline, next attempt at wifiNextAttempt
+  WIFI_CONNECTING,  // WiFi.begin() issued, waiting for an IP
+  WIFI_ONLINE
+};
+
+WifiState wifiState = WIFI_WAITING;
+WiFiEventHandler wifiGotIpHandler;         // Handlers unregister when destroyed
+WiFiEventHandler wifiDisconnectedHandler;
+volatile bool wifiGotIp = false;           // Set by the SDK event callbacks
+volatile bool wifiLost = false;
+unsigned long wifiAttemptStart = 0;
+unsigned long wifiNextAttempt = 0;
+unsigned long wifiRetryDelay = 0;
+const unsigned long wifiConnectTimeout = 15000;  // Give up on an attempt after 15 s
+const unsigned long wifiRetryMin = 1000;         // Backoff doubles from 1 s...
+const unsigned long wifiRetryMax = 60000;        // ...up to 1 minute
+const unsigned long wifiCheckInterval = 100;
+const unsigned long wifiRadioOffMin = 5000;      // Radio off for retry waits this long
+bool wifiRadioOff = false;
+
+WiFiClient wifiClient;
+WiFiClient pushClient;  // Held open by the long-poll push channel
+
+// One keep-alive HTTP client shared by telemetry, command and schedule requests,
+// so they reuse a single TCP connection instead of a handshake per request
+HTTPClient http;
+
+// Server JSON without heap churn: requests are serialized into a static buffer
+// and sent with its exact length; responses are parsed straight off the
+// socket, keeping only the fields named in these filters (initJsonFilters())
+#define POST_BODY_SIZE  1024
+char postBody[POST_BODY_SIZE];
+StaticJsonDocument<256> commandFilter;       // /api/hvac/command, push channel
+StaticJsonDocument<384> dataResponseFilter;  // /api/data
+StaticJsonDocument<128> scheduleFilter;      // /api/schedule/slots
+
+// HVAC Settings (see hvac_settings.h)
+HVACSettings hvacSettings;
+uint8_t settingsSource = SOURCE_ARDUINO;  // Track where change came from (HvacSource)
+
+// Room conditions from Arduino
+float roomTemp = 0.0;
 float roomHumidity = 0.0;
+unsigned long roomReadingAt = 0;   // millis() of the last conditions received
+bool roomReadingValid = false;
+
+// Link protocol state (see hvac_link.h / link_rx.h)
+LinkReceiver linkRx;
+bool linkBinary = false;  // Arduino understands binary frames
+LinkBaud linkBaud(true);  // Link rate; we probe faster rates (see link_baud.h)
+uint32_t linkUartOverruns = 0;  // Reported by the UART itself
+uint32_t linkUartErrors = 0;
+
+// Delta sync with the Arduino
+HVACSettings arduinoSettings;           // Last state the Arduino is known to have
+uint8_t linkTxSeq = 0;
+LinkSeqTracker linkRxSeq;
+bool arduinoKeyframeRequested = false;
+
+// Min/mean/max the Arduino reported since the last server keyframe
+// (see sensor_filter.h); posted as "window"
+SensorWindow tempWindow;
+SensorWindow humidityWindow;
+
+// Delta sync with the server: what the server last acknowledged
+HVACSettings postedSettings;
+int16_t postedTemp = 0;                 // centi-degrees C
+uint16_t postedHumidity = 0;            // centi-percent RH
+uint16_t serverSeq = 0;
+bool serverKeyframeRequested = true;    // Start with a full state
+
+// Push channel state
+enum PushState : uint8_t {
+  PUSH_IDLE,       // Ready to issue the next long-poll
+  PUSH_WAITING,    // Request sent, waiting for the server to answer
+  PUSH_DISABLED    // Server doesn't support push; polling only
+};
+
+PushState pushState = PUSH_IDLE;
+bool pushHealthy = false;        // Long-poll in place; polling not needed
+uint32_t commandVersion = 0;     // Last settings version seen from the server
+unsigned long pushRequestTime = 0;
+unsigned long pushRetryAt = 0;
+const unsigned long pushResponseTimeout = 35000; // Give up on a silent request
+const unsigned long pushRetryDelay = 5000;
+
+// Cooperative scheduler (see task_scheduler.h); setup() registers 12, the
+// rest is headroom so a new task doesn't silently fail to register
+TaskScheduler<16> scheduler([]() -> uint32_t { return millis(); });
+uint8_t serverTask = TASK_NONE;  // Triggered to post changes right away
+
+// Profiling spans (see profiler.h); "prof" on the serial port prints them and
+// keyframes posted to /api/data carry them as "prof"
+ProfileSpan profLoop("loop");
+ProfileSpan profServer("server");
+ProfileSpan profHttpPost("http_post");
+ProfileSpan profCommands("commands");
+ProfileSpan profIR("ir");
+ProfileSpan profSchedule("schedule");
+ProfileSpan profLinkToIR("link_to_ir");  // Arduino change received until IR sent
+ProfileSpan* const profSpans[] = {
+  &profLoop, &profServer, &profHttpPost, &profCommands, &profIR, &profSchedule, &profLinkToIR
+};
+uint32_t arduinoChangeAt = 0;
+bool arduinoChangePending = false;
+
+// Heap and stack health (see mem_stats.h); "mem" on the serial port prints
+// it and keyframes carry both boards' stats as "mem"
+MemLoopTracker memLoop;
+MemStats arduinoMem;             // Last LINK_MSG_MEM from the Arduino
+bool arduinoMemValid = false;
+
+// Latency trace for the last web command (its settings version is the ID).
+// Stage times are ms after the command reached the ESP, -1 = not reached.
+struct CommandTrace {
+  uint32_t id;
+  unsigned long rxAt;
+  int32_t irMs;          // IR sent
+  int32_t linkMs;        // Forwarded to the Arduino
+  int32_t displayMs;     // Arduino ACKed it on screen (binary link only)
+  uint8_t linkSeq;       // Link seq that carried it
+  bool awaitAck;
+  bool active;           // Stages still being recorded
+  bool ready;            // Complete, waiting to be posted
+};
+
+CommandTrace trace = {};
+const unsigned long traceTimeout = 5000;  // Post without the missing stages after this
+
+// Offline telemetry (see telemetry_ring.h): readings taken while the server
+// can't be reached, uploaded in batches once it can
+#define BATCH_MAX_SAMPLES  32
+TelemetryRing<256> backlog;
+unsigned long lastBacklogSample = 0;
+bool backlogSampled = false;
+const unsigned long backlogSampleInterval = 10000;  // One buffered reading per 10 s offline
+const unsigned long backlogDrainInterval = 500;     // One batch POST per 0.5 s while draining
+
+#ifdef TELEMETRY_SPILL_LITTLEFS
+// When the ring fills, its oldest chunk is appended to flash instead of dropped
+#define SPILL_CHUNK_SAMPLES  64
+const char* spillPath = "/telemetry.bin";
+const uint32_t spillMaxBytes = 64 * 1024;
+uint32_t spillSize = 0;        // Bytes written to the spill file
+uint32_t spillReadOffset = 0;  // Bytes already uploaded
+#endif
 
-// Timing
-unsigned long lastServerUpdate = 0;
-unsigned long lastCommandCheck = 0;
-unsigned long lastArduinoSend = 0;
-unsigned long lastScheduleCheck = 0;
-const unsigned long serverUpdateInterval = 2000;    // Send to server every 2 seconds (faster sync)
-const unsigned long commandCheckInterval = 500;     // Check server commands every 0.5 seconds
-const unsigned long arduinoSendInterval = 250;      // Push to Arduino quickly when needed
-const unsigned long scheduleCheckInterval = 30000;  // Check schedule every 30 seconds
+// Local schedule (see hvac_schedule.h): synced from the server, evaluated
+// against SNTP time with the schedule task armed for the next edge
+#define SCHEDULE_MIN_VALID_TIME  1600000000L  // Anything earlier: SNTP hasn't answered yet
+HvacSchedule schedule;
+bool scheduleSynced = false;
+bool scheduleCatchUp = false;   // Apply the slot in effect (after a sync) before waiting
+long scheduleUtcOffset = 0;     // Seconds, from the server
+time_t scheduleNextEdge = 0;    // Local edge the task is armed for, 0 = none
+uint8_t scheduleTask = TASK_NONE;
+uint8_t scheduleSyncTask = TASK_NONE;
+const unsigned long scheduleMaxSleep = 3600000;   // Re-read the clock at least hourly
+const unsigned long scheduleClockRetry = 1000;    // While waiting for SNTP
+const unsigned long scheduleSyncRetry = 30000;
+
+// Firmware updates (see serviceOta()): keyframe replies name a newer image
+// for this AC variant, which streams into the spare flash half over its own
+// connection while the hub keeps working, and the hub restarts into it once
+// nothing is pending. Set the version with -D FIRMWARE_VERSION=\"1.2.0\".
+// The server and the download are plain HTTP, so an image only boots if it
+// carries an RSA signature from the key in include/ota_public_key.h; builds
+// without that header take no updates from the server.
+#ifndef FIRMWARE_VERSION
+#define FIRMWARE_VERSION "dev"
+#endif
+#define OTA_CHUNK_SIZE  512   // Bytes off the socket and into flash per pass, at most
+
+enum OtaState {
+  OTA_IDLE,
+  OTA_OFFERED,      // The server named an image; the download starts next pass
+  OTA_DOWNLOADING,
+  OTA_READY,        // Written and verified; restart once the hub is quiet
+  OTA_FAILED        // Not offered again for otaRetryDelay
+};
+
+const char* const otaStateNames[] = { "idle", "offered", "downloading", "ready", "failed" };
+OtaState otaState = OTA_IDLE;
+WiFiClient otaClient;
+HTTPClient otaHttp;
+char otaVersion[24] = "";
+char otaMd5[33] = "";            // Checked by Update.end(); catches corruption only
+uint32_t otaSize = 0;
+uint32_t otaReceived = 0;
+unsigned long otaLastData = 0;
+unsigned long otaFailedAt = 0;
+uint8_t otaTask = TASK_NONE;
+const unsigned long otaStallTimeout = 30000;   // Give up on a download silent this long
+const unsigned long otaRetryDelay = 600000;    // Try a failed version again after 10 minutes
+const unsigned long otaQuietTime = 5000;       // No IR sent for this long before restarting
+#if OTA_SIGNED_UPDATES
+BearSSL::PublicKey otaSigningKey(otaPublicKey);
+BearSSL::HashSHA256 otaHash;
+BearSSL::SigningVerifier otaVerifier(&otaSigningKey);
+#endif
+
+// Timing (intervals shared with the latency bench are in hvac_timing.h)
+unsigned long lastServerKeyframe = 0;
 
 // Flags
 bool settingsChanged = false;
 bool needsACUpdate = false;
 
 // Function declarations
-void connectWiFi();
+void startWiFi();
+void serviceWiFi();
+void beginWiFiAttempt(unsigned long now);
+void wifiAttemptFailed(unsigned long now);
+bool wifiOnline();
 void receiveFromArduino();
+void handleJsonLine(char* line);
 void sendToArduino();
+void sendLinkFrame(uint8_t type, const uint8_t* payload, uint8_t len);
+void sendLinkHello();
+void handleLinkFrame();
+void serviceLinkBaud();
+void applyLinkBaud(uint8_t actions);
+LinkErrors linkErrors();
+void onArduinoSettingsChanged();
+void serviceAC();
 void updateAC();
+void serviceThermostat();
+bool thermostatActive();
+HVACSettings acSettings();
 void sendToServer();
+bool serverUpdatePending();
+void bufferSample();
+bool backlogPending();
+void drainBacklog();
+#ifdef TELEMETRY_SPILL_LITTLEFS
+bool spillOldest();
+uint16_t readSpill(TelemetrySample* out, uint16_t max);
+#endif
+void startTrace(uint32_t id);
+void markTraceStage(int32_t& stage);
+bool traceReady();
+void pollServerCommands();
 void checkServerCommands();
-void checkSchedule();
-void applyACSettings();
-String modeToString(uint8_t mode);
-String fanSpeedToString(uint8_t speed);
-uint8_t stringToMode(String mode);
-uint8_t stringToFanSpeed(String speed);
+void applyServerCommand(JsonObjectConst doc);
+#ifdef HUB_SERIAL_COMMANDS
+bool handleDebugCommand(const char* cmd);
+#endif
+void writeProfileJson(JsonObject prof);
+MemStats memSample();
+void writeMemJson(JsonObject obj, const MemStats& m);
+void writeWindowJson(JsonArray a, const SensorWindow& w);
+void servicePushChannel();
+void readPushResponse();
+void syncSchedule();
+void serviceSchedule();
+void applyACSettings(const HVACSettings& s);
+void initJsonFilters();
+void offerFirmware(JsonObjectConst fw);
+void serviceOta();
+void startOtaDownload();
+void continueOtaDownload();
+void failOta(const char* stage);
 
 void setup() {
-  Serial.begin(9600);  // Match Arduino's baud rate (was 115200)
+  // Link to the Arduino; starts at its 9600 baud and speeds up once both
+  // sides have proved a faster rate (see link_baud.h). A 1 KB receive
+  // buffer covers 20 ms at 460800 baud while an HTTP request blocks loop().
+  Serial.setRxBufferSize(1024);
+  Serial.begin(LINK_BAUD_BASE);
+#if HUB_DEBUG_UART
+  logSerial.begin(LOG_BAUD);
+#endif
   delay(10);
   
-  Serial.println("\nESP8266 HVAC Hub");
+  LOG_INFO("ESP8266 HVAC Hub (%s)", DEVICE_ID);
   
   // Initialize IR transmitter
   ac.begin();
-  Serial.println("IR Transmitter initialized");
+  irsend.begin();
+  LOG_INFO("IR transmitter initialized (%s)", AcBackend::kName);
+  
+  // Keep the server connection open between requests
+  http.setReuse(true);
+  initJsonFilters();
+  
+#if OTA_SIGNED_UPDATES
+  // Update.end() now rejects any image not signed with our key
+  Update.installSignature(&otaHash, &otaVerifier);
+#endif
+  
+#ifdef TELEMETRY_SPILL_LITTLEFS
+  // Spilled timestamps are relative to the previous boot's millis(), so a
+  // leftover file can't be dated anymore
+  if (LittleFS.begin()) {
+    LittleFS.remove(spillPath);
+  }
+#endif
+  
+  // Offer the binary link protocol; JSON stays in use until the Arduino answers
+  sendLinkHello();
   
-  // Connect to WiFi
-  connectWiFi();
+  // Start connecting; serviceWiFi() finishes the job in the background
+  startWiFi();
   
   // Initialize AC with default settings
-  applyACSettings();
+  applyACSettings(hvacSettings);
+  
+  // Link and IR work runs every pass and between the HTTP tasks
+  scheduler.every("link_rx", receiveFromArduino, 0, TASK_CRITICAL);
+  scheduler.every("link_tx", sendToArduino, 0, TASK_CRITICAL);
+  scheduler.every("ir", serviceAC, 0, TASK_CRITICAL);
+  scheduler.every("thermostat", serviceThermostat, thermostatInterval, TASK_NORMAL);
+  scheduler.every("wifi", serviceWiFi, wifiCheckInterval, TASK_HIGH);
+  
+  // Web commands arrive over the push channel; poll only while it's down
+  scheduler.every("push", servicePushChannel, 0, TASK_HIGH);
+  serverTask = scheduler.every("server", sendToServer, serverUpdateInterval, TASK_NORMAL,
+                               serverUpdateInterval);
+  scheduler.every("commands", pollServerCommands, commandCheckInterval, TASK_NORMAL,
+                  commandCheckInterval);
+  scheduleTask = scheduler.oneShot("schedule", serviceSchedule, TASK_NORMAL);
+  scheduleSyncTask = scheduler.oneShot("sched_sync", syncSchedule, TASK_BULK);
+  scheduler.every("backlog", drainBacklog, backlogDrainInterval, TASK_BULK);
+  otaTask = scheduler.oneShot("ota", serviceOta, TASK_BULK);
+  if (scheduler.rejected > 0) {
+    LOG_ERROR("Scheduler full, %u tasks not registered", scheduler.rejected);
+  }
   
-  Serial.println("System ready!");
+  LOG_INFO("System ready (firmware %s)", FIRMWARE_VERSION);
 }
 
 void loop() {
-  unsigned long currentTime = millis();
-  
-  // Receive data from Arduino
-  receiveFromArduino();
-  
-  // Send updates to Arduino if needed
-  if (currentTime - lastArduinoSend >= arduinoSendInterval) {
-    lastArduinoSend = currentTime;
-    sendToArduino();
+  {
+    ProfileScope scope(profLoop);
+    MemLoopScope memScope(memLoop);
+    scheduler.run();
   }
   
-  // Update AC if settings changed
-  if (needsACUpdate) {
-    needsACUpdate = false;
-    updateAC();
+  // Hand the rest of the millisecond to the SDK instead of spinning; the
+  // link's 1 KB RX buffer holds 20 ms even at 460800 baud
+  delay(1);
+}
+
+void startWiFi() {
+  WiFi.persistent(false);        // Credentials come from this file, skip flash writes
+  WiFi.mode(WIFI_STA);
+  WiFi.setAutoReconnect(false);  // Retries go through serviceWiFi()'s backoff
+  // Radio sleeps between beacons (DTIM) while associated; the AP holds our
+  // traffic until the next one, so a push reply waits at most one beacon
+  WiFi.setSleepMode(WIFI_MODEM_SLEEP);
+  
+  wifiGotIpHandler = WiFi.onStationModeGotIP([](const WiFiEventStationModeGotIP&) {
+    wifiGotIp = true;
+  });
+  wifiDisconnectedHandler = WiFi.onStationModeDisconnected(
+    [](const WiFiEventStationModeDisconnected&) {
+      wifiLost = true;
+    });
+  
+  beginWiFiAttempt(millis());
+}
+
+void serviceWiFi() {
+  unsigned long now = millis();
+  
+  if (wifiLost) {
+    wifiLost = false;
+    if (wifiState == WIFI_ONLINE) {
+      // Dropped after being up: retry soon, the AP is probably still there
+      LOG_WARN("WiFi lost");
+      wifiState = WIFI_WAITING;
+      wifiRetryDelay = 0;
+      wifiNextAttempt = now + wifiRetryMin;
+    }
+    // While connecting the SDK keeps trying on its own until the timeout
   }
   
-  // Send data to server periodically
-  if (currentTime - lastServerUpdate >= serverUpdateInterval) {
-    lastServerUpdate = currentTime;
-    sendToServer();
+  if (wifiGotIp) {
+    wifiGotIp = false;
+    if (wifiState != WIFI_ONLINE && WiFi.status() == WL_CONNECTED) {
+      wifiState = WIFI_ONLINE;
+      wifiRetryDelay = 0;
+      LOG_INFO("WiFi connected, IP %s", WiFi.localIP().toString().c_str());
+      LOG_INFO("Server URL: %s", serverUrl);
+#ifdef HUB_ARDUINO_OTA
+      ArduinoOTA.setHostname("hvac-" DEVICE_ID);
+      ArduinoOTA.setPassword(HUB_OTA_PASSWORD);
+      ArduinoOTA.begin();
+#endif
+      
+      // Post current state (and start draining any backlog) right away
+      scheduler.trigger(serverTask);
+      if (!scheduleSynced) {
+        scheduler.trigger(scheduleSyncTask);
+      }
+    }
   }
   
-  // Check for commands from server
-  if (currentTime - lastCommandCheck >= commandCheckInterval) {
-    lastCommandCheck = currentTime;
-    checkServerCommands();
+#ifdef HUB_ARDUINO_OTA
+  // LAN upload from the IDE; blocks everything else while it runs
+  if (wifiState == WIFI_ONLINE) {
+    ArduinoOTA.handle();
   }
+#endif
   
-  // Check schedule status
-  if (currentTime - lastScheduleCheck >= scheduleCheckInterval) {
-    lastScheduleCheck = currentTime;
-    checkSchedule();
+  if (wifiState == WIFI_CONNECTING && now - wifiAttemptStart >= wifiConnectTimeout) {
+    wifiAttemptFailed(now);
+  } else if (wifiState == WIFI_WAITING && (long)(now - wifiNextAttempt) >= 0) {
+    beginWiFiAttempt(now);
   }
 }
 
-void connectWiFi() {
-  Serial.print("Connecting to WiFi: ");
-  Serial.println(ssid);
+void beginWiFiAttempt(unsigned long now) {
+  LOG_INFO("Connecting to WiFi: %s", ssid);
+  
+  if (wifiRadioOff) {
+    WiFi.forceSleepWake();
+    delay(1);
+    wifiRadioOff = false;
+  }
   
   WiFi.begin(ssid, password);
+  wifiState = WIFI_CONNECTING;
+  wifiAttemptStart = now;
+}
+
+void wifiAttemptFailed(unsigned long now) {
+  WiFi.disconnect();
   
-  int attempts = 0;
-  while (WiFi.status() != WL_CONNECTED && attempts < 30) {
-    delay(500);
-    Serial.print(".");
-    attempts++;
+  if (wifiRetryDelay == 0) {
+    wifiRetryDelay = wifiRetryMin;
+  } else if (wifiRetryDelay < wifiRetryMax) {
+    wifiRetryDelay = min(wifiRetryDelay * 2, wifiRetryMax);
   }
+  wifiState = WIFI_WAITING;
+  wifiNextAttempt = now + wifiRetryDelay;
   
-  if (WiFi.status() == WL_CONNECTED) {
-    Serial.println("\nWiFi connected!");
-    Serial.print("IP address: ");
-    Serial.println(WiFi.localIP());
-    Serial.print("Server URL: ");
-    Serial.println(serverUrl);
-  } else {
-    Serial.println("\nWiFi connection failed!");
+  // Nothing to listen for until the next attempt
+  if (wifiRetryDelay >= wifiRadioOffMin) {
+    WiFi.forceSleepBegin();
+    wifiRadioOff = true;
   }
+  
+  LOG_WARN("WiFi connection failed, retrying in %lu s", wifiRetryDelay / 1000);
+}
+
+bool wifiOnline() {
+  return wifiState == WIFI_ONLINE;
 }
 
 void receiveFromArduino() {
-  if (Serial.available() > 0) {
-    String jsonString = Serial.readStringUntil('\n');
+  // Drain whatever has arrived without waiting for the rest of a message
+  while (Serial.available() > 0 && !linkRx.full()) {
+    linkRx.write((uint8_t)Serial.read());
+  }
+  if (Serial.hasOverrun()) {
+    linkUartOverruns++;
+  }
+  if (Serial.hasRxError()) {
+    linkUartErrors++;
+  }
+  
+  LinkRxEvent event;
+  while ((event = linkRx.poll()) != LINK_RX_NONE) {
+    if (event == LINK_RX_FRAME) {
+      handleLinkFrame();
+    } else {
+      handleJsonLine(linkRx.line);
+    }
+  }
+}
+
+void handleJsonLine(char* line) {
+#ifdef HUB_SERIAL_COMMANDS
+  // Plain-text debug commands typed on the serial port
+  if (handleDebugCommand(line)) {
+    return;
+  }
+#endif
+  
+  // Parse JSON from Arduino in place (zero-copy) from the receive line buffer
+  StaticJsonDocument<512> doc;
+  DeserializationError error = deserializeJson(doc, line);
+  
+  if (!error) {
+    // Arduino is speaking JSON, so fall back to JSON ourselves
+    linkBinary = false;
     
-    // Parse JSON from Arduino
-    StaticJsonDocument<512> doc;
-    DeserializationError error = deserializeJson(doc, jsonString);
+    // Update room conditions
+    if (doc.containsKey("roomTemp")) {
+      roomTemp = doc["roomTemp"];
+      roomReadingAt = millis();
+      roomReadingValid = true;
+    }
+    if (doc.containsKey("roomHumidity")) {
+      roomHumidity = doc["roomHumidity"];
+    }
     
-    if (!error) {
-      // Update room conditions
-      if (doc.containsKey("roomTemp")) {
-        roomTemp = doc["roomTemp"];
+    // Update HVAC settings if changed from Arduino
+    if (doc.containsKey("hvac")) {
+      readSettingsJson(doc["hvac"], arduinoSettings, kLinkJsonKeys);
+      if (arduinoSettings != hvacSettings) {
+        hvacSettings = arduinoSettings;
+        onArduinoSettingsChanged();
       }
-      if (doc.containsKey("roomHumidity")) {
-        roomHumidity = doc["roomHumidity"];
+    }
+  }
+}
+
+void onArduinoSettingsChanged() {
+  LOG_INFO("Settings updated from Arduino");
+  settingsSource = SOURCE_ARDUINO;
+  needsACUpdate = true;
+  settingsChanged = true;
+  if (!arduinoChangePending) {
+    arduinoChangeAt = micros();
+    arduinoChangePending = true;
+  }
+  // Notify server this pass to prevent stale web command override
+  scheduler.trigger(serverTask);
+}
+
+void sendLinkFrame(uint8_t type, const uint8_t* payload, uint8_t len) {
+  uint8_t frame[LINK_MAX_FRAME];
+  size_t frameLen = linkEncodeFrame(type, payload, len, frame);
+  Serial.write(frame, frameLen);
+  linkBaud.sent(millis());
+}
+
+void sendLinkHello() {
+  uint8_t payload[1] = { LINK_VERSION };
+  sendLinkFrame(LINK_MSG_HELLO, payload, sizeof(payload));
+}
+
+void handleLinkFrame() {
+  // Any valid frame proves the Arduino speaks the binary protocol
+  bool wasBinary = linkBinary;
+  linkBinary = true;
+  if (!wasBinary) {
+    linkBaud.begin(millis());
+  }
+  linkBaud.heard(millis());
+  
+  const LinkFrameParser& frame = linkRx.frame;
+  
+  switch (frame.type) {
+    case LINK_MSG_HELLO:
+      if (!wasBinary) {
+        sendLinkHello();
       }
+      break;
       
-      // Update HVAC settings if changed from Arduino
-      if (doc.containsKey("hvac")) {
-        JsonObject hvac = doc["hvac"];
-        bool changed = false;
-        
-        if (hvac.containsKey("power")) {
-          String newPower = hvac["power"].as<String>();
-          if (newPower != hvacSettings.power) {
-            hvacSettings.power = newPower;
-            changed = true;
-          }
-        }
-        
-        if (hvac.containsKey("setTemp")) {
-          int newTemp = hvac["setTemp"];
-          if (newTemp != hvacSettings.setTemp) {
-            hvacSettings.setTemp = newTemp;
-            changed = true;
-          }
-        }
-        
-        if (hvac.containsKey("mode")) {
-          String newMode = hvac["mode"].as<String>();
-          if (newMode != hvacSettings.mode) {
-            hvacSettings.mode = newMode;
-            changed = true;
-          }
-        }
-        
-        if (hvac.containsKey("fanSpeed")) {
-          String newFanSpeed = hvac["fanSpeed"].as<String>();
-          if (newFanSpeed != hvacSettings.fanSpeed) {
-            hvacSettings.fanSpeed = newFanSpeed;
-            changed = true;
-          }
-        }
-        
-        if (hvac.containsKey("timer")) {
-          int newTimer = hvac["timer"];
-          if (newTimer != hvacSettings.timer) {
-            hvacSettings.timer = newTimer;
-            changed = true;
-          }
-        }
-        
-        if (hvac.containsKey("swing")) {
-          String newSwing = hvac["swing"].as<String>();
-          if (newSwing != hvacSettings.swing) {
-            hvacSettings.swing = newSwing;
-            changed = true;
-          }
-        }
-        
-        if (changed) {
-          Serial.println("Settings updated from Arduino");
-          hvacSettings.source = "arduino";
-          needsACUpdate = true;
-          settingsChanged = true;
-          // Immediately notify server to prevent stale web command override
-          sendToServer();
-        }
+    case LINK_MSG_STATE: {
+      if (frame.len < LINK_CONDITIONS_SIZE + LINK_SETTINGS_SIZE + 1) break;
+      LinkConditions conditions;
+      linkGetConditions(frame.payload, conditions);
+      linkGetSettings(frame.payload + LINK_CONDITIONS_SIZE, arduinoSettings);
+      linkRxSeq.keyframe(frame.payload[LINK_CONDITIONS_SIZE + LINK_SETTINGS_SIZE]);
+      
+      if (frame.len >= LINK_CONDITIONS_SIZE + LINK_SETTINGS_SIZE + 1 + LINK_WINDOW_SIZE) {
+        SensorWindow temp, humidity;
+        linkGetWindow(frame.payload + LINK_CONDITIONS_SIZE + LINK_SETTINGS_SIZE + 1, temp, humidity);
+        tempWindow.merge(temp);
+        humidityWindow.merge(humidity);
+      }
+      
+      roomTemp = conditions.temp / 100.0f;
+      roomHumidity = conditions.humidity / 100.0f;
+      roomReadingAt = millis();
+      roomReadingValid = true;
+      
+      if (arduinoSettings != hvacSettings) {
+        hvacSettings = arduinoSettings;
+        onArduinoSettingsChanged();
+      }
+      break;
+    }
+    
+    case LINK_MSG_DELTA: {
+      uint8_t seq, mask;
+      HVACSettings incoming = arduinoSettings;
+      LinkConditions conditions;
+      if (!linkGetDelta(frame.payload, frame.len, seq, mask, incoming, conditions)) break;
+      arduinoSettings = incoming;
+      
+      if (mask & LINK_DELTA_CONDITIONS) {
+        roomTemp = conditions.temp / 100.0f;
+        roomHumidity = conditions.humidity / 100.0f;
+        roomReadingAt = millis();
+        roomReadingValid = true;
+      }
+      
+      // Only take the fields the Arduino actually changed
+      uint8_t changed = settingsDiff(incoming, hvacSettings) & mask & FIELD_ALL;
+      if (changed) {
+        applySettingsFields(hvacSettings, incoming, changed);
+        onArduinoSettingsChanged();
       }
+      
+      // A lost delta may have left other fields stale
+      if (!linkRxSeq.delta(seq)) {
+        sendLinkFrame(LINK_MSG_SYNC_REQ, nullptr, 0);
+      }
+      break;
     }
+    
+    case LINK_MSG_SYNC_REQ:
+      arduinoKeyframeRequested = true;
+      break;
+    
+    case LINK_MSG_ACK:
+      // Acks cover every message up to their seq
+      if (frame.len >= 1 && trace.awaitAck &&
+          (uint8_t)(frame.payload[0] - trace.linkSeq) < 128) {
+        markTraceStage(trace.displayMs);
+      }
+      break;
+    
+    case LINK_MSG_MEM:
+      if (frame.len >= LINK_MEM_SIZE) {
+        linkGetMem(frame.payload, arduinoMem);
+        arduinoMemValid = true;
+      }
+      break;
+    
+    case LINK_MSG_BAUD:
+      applyLinkBaud(linkBaud.onBaud(frame.payload, frame.len, millis()));
+      break;
+    
+    case LINK_MSG_PROBE:
+      applyLinkBaud(linkBaud.onProbe(frame.payload, frame.len, millis()));
+      break;
+    
+    default:
+      break;
+  }
+}
+
+LinkErrors linkErrors() {
+  LinkErrors e;
+  e.crc = linkRx.frame.crcErrors + linkUartErrors;
+  e.overruns = linkRx.ringOverruns + linkUartOverruns;
+  e.gaps = linkRxSeq.gaps;
+  return e;
+}
+
+void serviceLinkBaud() {
+  // Only a binary peer takes part; a JSON-only Arduino stays at 9600
+  if (!linkBinary && linkBaud.index == 0) {
+    return;
+  }
+  applyLinkBaud(linkBaud.poll(millis(), linkErrors().total()));
+}
+
+void applyLinkBaud(uint8_t actions) {
+  if (actions & LINK_BAUD_SEND) {
+    sendLinkFrame(linkBaud.outType, linkBaud.out, linkBaud.outLen);
+  }
+  if (actions & LINK_BAUD_SWITCH) {
+    // Let the frame leave at the old rate before changing it
+    Serial.flush();
+    Serial.updateBaudRate(linkBaud.baud());
+    linkRx.frame.reset();
+    arduinoKeyframeRequested = true;  // Resync whatever a bad rate may have lost
   }
 }
 
 void sendToArduino() {
-  // Send current HVAC settings back to Arduino
-  // (in case they were changed from web)
-  if (hvacSettings.source == "web") {
+  serviceLinkBaud();
+  
+  // Send only what the Arduino doesn't have yet
+  // (settings changed from web or schedule)
+  uint8_t mask = settingsDiff(hvacSettings, arduinoSettings);
+  if (mask == 0 && !arduinoKeyframeRequested) {
+    return;
+  }
+  
+  if (linkBinary) {
+    uint8_t payload[LINK_MAX_PAYLOAD];
+    uint8_t len;
+    uint8_t type;
+    
+    if (arduinoKeyframeRequested) {
+      linkPutSettings(payload, hvacSettings);
+      payload[LINK_SETTINGS_SIZE] = linkTxSeq;
+      len = LINK_SETTINGS_SIZE + 1;
+      type = LINK_MSG_SETTINGS;
+    } else {
+      LinkConditions none = { 0, 0 };
+      len = linkPutDelta(payload, linkTxSeq, mask, hvacSettings, none);
+      type = LINK_MSG_DELTA;
+    }
+    sendLinkFrame(type, payload, len);
+    if (trace.active && trace.linkMs < 0) {
+      trace.linkSeq = linkTxSeq;
+      trace.awaitAck = true;
+    }
+    linkTxSeq++;
+  } else {
+    // JSON fallback always carries the full state
     StaticJsonDocument<512> doc;
     
     JsonObject hvac = doc.createNestedObject("hvac");
-    hvac["power"] = hvacSettings.power;
-    hvac["setTemp"] = hvacSettings.setTemp;
-    hvac["mode"] = hvacSettings.mode;
-    hvac["fanSpeed"] = hvacSettings.fanSpeed;
-    hvac["timer"] = hvacSettings.timer;
-    hvac["swing"] = hvacSettings.swing;
+    writeSettingsJson(hvac, hvacSettings, kLinkJsonKeys);
     
     serializeJson(doc, Serial);
     Serial.println();
-    
-    hvacSettings.source = "synced";  // Mark as synced
+  }
+  
+  markTraceStage(trace.linkMs);
+  arduinoSettings = hvacSettings;
+  arduinoKeyframeRequested = false;
+  if (settingsSource != SOURCE_ARDUINO) {
+    settingsSource = SOURCE_SYNCED;  // Mark as synced
   }
 }
 
+void serviceAC() {
+  unsigned long now = millis();
+  
+  // Update AC if settings changed, once the burst of changes settles
+  if (needsACUpdate) {
+    needsACUpdate = false;
+    if (!acPending) {
+      acPending = true;
+      acFirstChange = now;
+    }
+    acLastChange = now;
+  }
+  if (!acPending) {
+    return;
+  }
+  if (now - acLastChange < irCoalesceWindow && now - acFirstChange < irMaxDelay) {
+    return;
+  }
+  acPending = false;
+  
+  // Changes that cancelled out (or only touched the timer) need no IR send
+  if (irSentValid && settingsKey(acSettings(), IR_CACHE_FIELDS) ==
+                     settingsKey(irSentSettings, IR_CACHE_FIELDS)) {
+    arduinoChangePending = false;
+    return;
+  }
+  updateAC();
+}
+
 void updateAC() {
-  Serial.println("Updating AC...");
-  applyACSettings();
+  ProfileScope scope(profIR);
+  LOG_DEBUG("Updating AC");
+  
+  // The user's settings, as corrected by the thermostat
+  HVACSettings target = acSettings();
+  uint32_t key = settingsKey(target, IR_CACHE_FIELDS);
+  IrFrame* frame = irCache.find(key);
+  if (frame == nullptr) {
+    applyACSettings(target);
+    frame = &irCache.insert(key);
+    memcpy(frame->state, ac.getRaw(), AcBackend::kStateLength);  // getRaw() fixes the checksum
+  }
   
   // Send IR command
-  ac.send();
-  
-  Serial.println("AC updated successfully");
-  Serial.print("  Power: ");
-  Serial.println(hvacSettings.power);
-  Serial.print("  Temp: ");
-  Serial.println(hvacSettings.setTemp);
-  Serial.print("  Mode: ");
-  Serial.println(hvacSettings.mode);
-  Serial.print("  Fan: ");
-  Serial.println(hvacSettings.fanSpeed);
-  Serial.print("  Swing: ");
-  Serial.println(hvacSettings.swing);
-}
-
-void applyACSettings() {
-  // Apply settings to IR library
-  // Note: Adjust these based on your AC brand's library
-  
-  // Power
-  if (hvacSettings.power == "on") {
-    ac.on();
-  } else {
-    ac.off();
+  AcBackend::sendRaw(irsend, frame->state);
+  irSentSettings = target;
+  irSentValid = true;
+  markTraceStage(trace.irMs);
+  if (arduinoChangePending) {
+    profLinkToIR.record(micros() - arduinoChangeAt);
+    arduinoChangePending = false;
   }
   
-  // Temperature
-  ac.setTemp(hvacSettings.setTemp);
+  LOG_INFO("AC updated: power %s, %u C, mode %s, fan %s, swing %s", onOffName(target.power),
+           target.setTemp, modeName(target.mode), fanName(target.fanSpeed),
+           onOffName(target.swing));
+}
+
+void applyACSettings(const HVACSettings& s) {
+  // Apply settings to the IR library through the selected backend
+  acApply<AcBackend>(ac, s);
+}
+
+bool thermostatActive() {
+  return thermostatEnabled && roomReadingValid && millis() - roomReadingAt < thermostatStaleAfter;
+}
+
+// What the AC should be running: the user's settings, corrected by the
+// thermostat while it has a recent room reading
+HVACSettings acSettings() {
+  return thermostatActive() ? thermostat.apply(hvacSettings) : hvacSettings;
+}
+
+void serviceThermostat() {
+  unsigned long now = millis();
+  if (thermostatActive()) {
+    thermostat.update(hvacSettings, (int16_t)lroundf(roomTemp * 100.0f), now);
+  } else {
+    thermostat.reset();
+  }
   
-  // Mode
-  ac.setMode(stringToMode(hvacSettings.mode));
+  // User changes go out through serviceAC() right away; the controller's own
+  // changes are rate limited so the AC isn't re-commanded every step
+  if (acPending || (!irSentValid && !thermostatActive())) {
+    return;   // Also: nothing to hand back before the first send
+  }
+  if (irSentValid && settingsKey(acSettings(), IR_CACHE_FIELDS) ==
+                     settingsKey(irSentSettings, IR_CACHE_FIELDS)) {
+    return;
+  }
+  if (thermostatSent && now - lastThermostatSend < thermostatMinSendGap) {
+    return;
+  }
+  thermostatSent = true;
+  lastThermostatSend = now;
+  needsACUpdate = true;
+}
+
+void initJsonFilters() {
+  // Field names are literals, so the filters hold pointers rather than copies
+  const char* const commandFields[] = {
+    "version", "source", "power", kServerJsonKeys.setTemp, "mode", kServerJsonKeys.fanSpeed,
+    "timer", "swing"
+  };
+  for (const char* field : commandFields) {
+    commandFilter[field] = true;
+  }
   
-  // Fan Speed
-  ac.setFan(stringToFanSpeed(hvacSettings.fanSpeed));
+  dataResponseFilter["resync"] = true;
+  dataResponseFilter["schedule_version"] = true;
+  dataResponseFilter["command"] = commandFilter;
+  dataResponseFilter["firmware"] = true;
   
-  // Swing
-  if (hvacSettings.swing == "on") {
-    ac.setSwingVertical(true);
-  } else {
-    ac.setSwingVertical(false);
-  }
+  scheduleFilter["version"] = true;
+  scheduleFilter["enabled"] = true;
+  scheduleFilter["utc_offset"] = true;
+  scheduleFilter["slots"][0] = true;  // Applies to every slot
 }
 
 void sendToServer() {
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("WiFi not connected!");
-    connectWiFi();
+  if (!wifiOnline()) {
+    // Keep the reading for later; serviceWiFi() is reconnecting
+    bufferSample();
     return;
   }
   
-  HTTPClient http;
+  // Only post what the server doesn't have yet, plus a periodic keyframe
+  if (!serverUpdatePending()) {
+    return;
+  }
+  ProfileScope scope(profServer);
+  
+  unsigned long now = millis();
+  int16_t temp = (int16_t)lroundf(roomTemp * 100.0f);
+  uint16_t humidity = (uint16_t)lroundf(roomHumidity * 100.0f);
+  uint8_t mask = settingsDiff(hvacSettings, postedSettings);
+  bool conditionsDirty = temp != postedTemp || humidity != postedHumidity;
+  bool keyframe = serverKeyframeRequested || now - lastServerKeyframe >= serverKeyframeInterval;
+  if (keyframe) {
+    mask = FIELD_ALL;
+  }
   
   http.begin(wifiClient, serverUrl);
   http.addHeader("Content-Type", "application/json");
   
-  // Create JSON payload with sensor data and HVAC settings
-  StaticJsonDocument<512> doc;
-  doc["temperature"] = roomTemp;
-  doc["humidity"] = roomHumidity;
+  // Create JSON payload with changed sensor data and HVAC settings
+  // Static keeps the 1.75 KB document off the ESP8266's 4 KB stack
+  static StaticJsonDocument<1792> doc;
+  doc.clear();
+  doc["seq"] = serverSeq;
+  doc["cmd_version"] = commandVersion;  // Server piggybacks any newer web command
+  if (keyframe) {
+    doc["keyframe"] = true;
+    JsonObject fw = doc.createNestedObject("fw");
+    fw["version"] = FIRMWARE_VERSION;
+    fw["variant"] = AcBackend::kName;
+    if (otaState != OTA_IDLE) {
+      JsonObject ota = doc.createNestedObject("ota");
+      ota["version"] = otaVersion;
+      ota["state"] = otaStateNames[otaState];
+      ota["received"] = otaReceived;
+      ota["size"] = otaSize;
+    }
+  }
+  if (keyframe || conditionsDirty) {
+    doc["temperature"] = roomTemp;
+    doc["humidity"] = roomHumidity;
+  }
   
-  // Add HVAC settings
-  JsonObject hvac = doc.createNestedObject("hvac");
-  hvac["power"] = hvacSettings.power;
-  hvac["set_temp"] = hvacSettings.setTemp;
-  hvac["mode"] = hvacSettings.mode;
-  hvac["fan_speed"] = hvacSettings.fanSpeed;
-  hvac["timer"] = hvacSettings.timer;
-  hvac["swing"] = hvacSettings.swing;
+  // Add changed HVAC settings
+  if (mask != 0) {
+    JsonObject hvac = doc.createNestedObject("hvac");
+    writeSettingsJson(hvac, hvacSettings, kServerJsonKeys, mask);
+  }
   
-  String jsonData;
-  serializeJson(doc, jsonData);
+  // Timing and memory stats ride along with the once-a-minute keyframe
+  if (keyframe) {
+    writeProfileJson(doc.createNestedObject("prof"));
+    JsonObject mem = doc.createNestedObject("mem");
+    writeMemJson(mem.createNestedObject("esp"), memSample());
+    if (arduinoMemValid) {
+      writeMemJson(mem.createNestedObject("r4"), arduinoMem);
+    }
+    
+    // What the thermostat is sending the AC in place of the user's settings
+    if (thermostatActive()) {
+      HVACSettings target = acSettings();
+      JsonObject control = doc.createNestedObject("thermostat");
+      control["error"] = thermostat.error / 100.0f;
+      control["offset"] = thermostat.offset / 100.0f;
+      control["power"] = onOffName(target.power);
+      control["set_temp"] = target.setTemp;
+      control["fan_speed"] = fanName(target.fanSpeed);
+    }
+    
+    // Serial link rate and the errors the hub has seen on it
+    LinkErrors errors = linkErrors();
+    JsonObject link = doc.createNestedObject("link");
+    link["baud"] = linkBaud.baud();
+    link["crc"] = errors.crc;
+    link["overruns"] = errors.overruns;
+    link["gaps"] = errors.gaps;
+    link["fallbacks"] = linkBaud.fallbacks;
+    link["probe_failures"] = linkBaud.probeFailures;
+    
+    // Range of the readings the deadband kept off the wire
+    if (tempWindow.count > 0) {
+      JsonObject window = doc.createNestedObject("window");
+      window["n"] = tempWindow.count;
+      writeWindowJson(window.createNestedArray("temperature"), tempWindow);
+      writeWindowJson(window.createNestedArray("humidity"), humidityWindow);
+    }
+  }
   
-  Serial.print("Sending to server: ");
-  Serial.println(jsonData);
+  // Stage times for the last web command (see /api/latency)
+  bool tracePosted = traceReady();
+  if (tracePosted) {
+    JsonObject t = doc.createNestedObject("trace");
+    t["id"] = trace.id;
+    if (trace.irMs >= 0) t["ir"] = trace.irMs;
+    if (trace.linkMs >= 0) t["link"] = trace.linkMs;
+    if (trace.displayMs >= 0) t["display"] = trace.displayMs;
+  }
   
-  // Send POST request
-  int httpResponseCode = http.POST(jsonData);
+  if (measureJson(doc) >= sizeof(postBody)) {
+    LOG_WARN("Telemetry too large, skipped");
+    http.end();
+    return;
+  }
+  size_t len = serializeJson(doc, postBody, sizeof(postBody));
+  
+  LOG_DEBUG("Sending to server: %s", postBody);
+  
+  // Send POST request (Content-Length is len, the body goes out as-is)
+  int httpResponseCode;
+  {
+    ProfileScope postScope(profHttpPost);
+    httpResponseCode = http.POST((uint8_t*)postBody, len);
+  }
   
   if (httpResponseCode > 0) {
-    Serial.print("Server response: ");
-    Serial.println(httpResponseCode);
+    LOG_DEBUG("Server response: %d", httpResponseCode);
+  }
+  
+  if (httpResponseCode == 200) {
+    // Server has this state now; anything unacknowledged stays dirty for the next cycle
+    serverSeq++;
+    if (tracePosted) {
+      trace.ready = false;
+    }
+    postedSettings = hvacSettings;
+    postedTemp = temp;
+    postedHumidity = humidity;
+    if (keyframe) {
+      tempWindow.reset();
+      humidityWindow.reset();
+      lastServerKeyframe = now;
+      serverKeyframeRequested = false;
+    }
+    
+    // Server asks for a keyframe when it notices a sequence gap, and
+    // includes any pending web command so no separate GET is needed
+    StaticJsonDocument<640> response;
+    if (!deserializeJson(response, http.getStream(),
+                         DeserializationOption::Filter(dataResponseFilter))) {
+      if (response["resync"] == true) {
+        serverKeyframeRequested = true;
+      }
+      if (response.containsKey("command")) {
+        applyServerCommand(response["command"]);
+      }
+      if (response.containsKey("firmware")) {
+        offerFirmware(response["firmware"]);
+      }
+      // Schedule edits only bump the version; fetch the slots once per change
+      if (response.containsKey("schedule_version") &&
+          (!scheduleSynced || response["schedule_version"] != schedule.version)) {
+        scheduler.trigger(scheduleSyncTask);
+      }
+    }
   } else {
-    Serial.print("Error sending data: ");
-    Serial.println(httpResponseCode);
+    // Server unreachable: don't lose the reading
+    if (keyframe || conditionsDirty) {
+      bufferSample();
+    }
+    if (httpResponseCode <= 0) {
+      LOG_WARN("Error sending data: %d", httpResponseCode);
+    }
+  }
+  
+  http.end();
+}
+
+void bufferSample() {
+  unsigned long now = millis();
+  if (backlogSampled && now - lastBacklogSample < backlogSampleInterval) {
+    return;
+  }
+  lastBacklogSample = now;
+  backlogSampled = true;
+  
+#ifdef TELEMETRY_SPILL_LITTLEFS
+  if (backlog.full()) {
+    spillOldest();
+  }
+#endif
+  
+  TelemetrySample sample;
+  sample.t = now;
+  sample.temp = (int16_t)lroundf(roomTemp * 100.0f);
+  sample.humidity = (uint16_t)lroundf(roomHumidity * 100.0f);
+  backlog.push(sample);
+}
+
+bool backlogPending() {
+#ifdef TELEMETRY_SPILL_LITTLEFS
+  if (spillReadOffset < spillSize) {
+    return true;
+  }
+#endif
+  return !backlog.empty();
+}
+
+// Uploads the oldest buffered readings (spill file first) in one POST
+void drainBacklog() {
+  if (!wifiOnline() || !backlogPending()) {
+    return;
   }
   
+  TelemetrySample batch[BATCH_MAX_SAMPLES];
+  uint16_t count = 0;
+  bool fromSpill = false;
+#ifdef TELEMETRY_SPILL_LITTLEFS
+  count = readSpill(batch, BATCH_MAX_SAMPLES);
+  fromSpill = count > 0;
+#endif
+  if (!fromSpill) {
+    count = backlog.size() < BATCH_MAX_SAMPLES ? backlog.size() : BATCH_MAX_SAMPLES;
+    for (uint16_t i = 0; i < count; i++) {
+      batch[i] = backlog.at(i);
+    }
+  }
+  
+  static char body[BATCH_MAX_SAMPLES * TELEMETRY_BATCH_ENTRY_MAX + TELEMETRY_BATCH_OVERHEAD];
+  size_t len = telemetryBatchJson(body, sizeof(body), millis(), batch, count);
+  if (len == 0) {
+    return;
+  }
+  
+  http.begin(wifiClient, batchUrl);
+  http.addHeader("Content-Type", "application/json");
+  int httpResponseCode = http.POST((uint8_t*)body, len);
   http.end();
+  
+  if (httpResponseCode != 200) {
+    return;  // Retry the same batch next time
+  }
+  
+  LOG_INFO("Uploaded buffered readings: %u", count);
+  
+#ifdef TELEMETRY_SPILL_LITTLEFS
+  if (fromSpill) {
+    spillReadOffset += count * sizeof(TelemetrySample);
+    if (spillReadOffset >= spillSize) {
+      LittleFS.remove(spillPath);
+      spillSize = 0;
+      spillReadOffset = 0;
+    }
+    return;
+  }
+#endif
+  backlog.pop(count);
+}
+
+#ifdef TELEMETRY_SPILL_LITTLEFS
+// Moves the ring's oldest chunk to flash; false if flash is full too
+bool spillOldest() {
+  uint32_t bytes = SPILL_CHUNK_SAMPLES * sizeof(TelemetrySample);
+  if (spillSize + bytes > spillMaxBytes) {
+    return false;
+  }
+  
+  File f = LittleFS.open(spillPath, "a");
+  if (!f) {
+    return false;
+  }
+  for (uint16_t i = 0; i < SPILL_CHUNK_SAMPLES && i < backlog.size(); i++) {
+    f.write((const uint8_t*)&backlog.at(i), sizeof(TelemetrySample));
+  }
+  f.close();
+  
+  backlog.pop(SPILL_CHUNK_SAMPLES);
+  spillSize += bytes;
+  return true;
+}
+
+uint16_t readSpill(TelemetrySample* out, uint16_t max) {
+  if (spillReadOffset >= spillSize) {
+    return 0;
+  }
+  
+  File f = LittleFS.open(spillPath, "r");
+  if (!f) {
+    return 0;
+  }
+  size_t bytes = 0;
+  if (f.seek(spillReadOffset)) {
+    bytes = f.read((uint8_t*)out, max * sizeof(TelemetrySample));
+  }
+  f.close();
+  return bytes / sizeof(TelemetrySample);
+}
+#endif
+
+bool serverUpdatePending() {
+  int16_t temp = (int16_t)lroundf(roomTemp * 100.0f);
+  uint16_t humidity = (uint16_t)lroundf(roomHumidity * 100.0f);
+  
+  return serverKeyframeRequested || traceReady() ||
+         millis() - lastServerKeyframe >= serverKeyframeInterval ||
+         settingsDiff(hvacSettings, postedSettings) != 0 ||
+         temp != postedTemp || humidity != postedHumidity;
+}
+
+void startTrace(uint32_t id) {
+  trace = {};
+  trace.id = id;
+  trace.rxAt = millis();
+  trace.irMs = -1;
+  trace.linkMs = -1;
+  trace.displayMs = -1;
+  trace.active = true;
+}
+
+void markTraceStage(int32_t& stage) {
+  if (trace.active && stage < 0) {
+    stage = (int32_t)(millis() - trace.rxAt);
+  }
+  
+  // Done once IR and link are through and the display ACK (if any) is in
+  bool complete = trace.irMs >= 0 && trace.linkMs >= 0 &&
+                  (!trace.awaitAck || trace.displayMs >= 0);
+  if (trace.active && complete) {
+    trace.active = false;
+    trace.ready = true;
+    scheduler.trigger(serverTask);
+  }
+}
+
+// Finishes a trace whose remaining stages never arrived
+bool traceReady() {
+  if (trace.active && millis() - trace.rxAt >= traceTimeout) {
+    trace.active = false;
+    trace.ready = true;
+  }
+  return trace.ready;
+}
+
+void pollServerCommands() {
+  if (!pushHealthy) {
+    checkServerCommands();
+  }
 }
 
 void checkServerCommands() {
-  if (WiFi.status() != WL_CONNECTED) {
+  if (!wifiOnline()) {
     return;
   }
+  ProfileScope scope(profCommands);
   
-  HTTPClient http;
+  // With telemetry pending, one POST uploads it and returns any pending command
+  if (serverUpdatePending()) {
+    sendToServer();
+    return;
+  }
   
   http.begin(wifiClient, commandUrl);
   
+  // Server answers 304 when nothing changed since the version we have
+  char etag[16];
+  snprintf(etag, sizeof(etag), "\"v%lu\"", (unsigned long)commandVersion);
+  http.addHeader("If-None-Match", etag);
+  
   int httpResponseCode = http.GET();
   
   if (httpResponseCode == 200) {
-    String response = http.getString();
-    
     // Parse JSON response
-    StaticJsonDocument<512> doc;
-    DeserializationError error = deserializeJson(doc, response);
+    StaticJsonDocument<384> doc;
+    DeserializationError error = deserializeJson(doc, http.getStream(),
+                                                 DeserializationOption::Filter(commandFilter));
     
-    if (!error && doc.containsKey("source")) {
-      String source = doc["source"].as<String>();
-      
-      // Only process if changes came from web
-      if (source == "web") {
-        bool changed = false;
-        
-        if (doc.containsKey("power")) {
-          String newPower = doc["power"].as<String>();
-          if (newPower != hvacSettings.power) {
-            hvacSettings.power = newPower;
-            changed = true;
-          }
-        }
-        
-        if (doc.containsKey("set_temp")) {
-          int newTemp = doc["set_temp"];
-          if (newTemp != hvacSettings.setTemp) {
-            hvacSettings.setTemp = newTemp;
-            changed = true;
-          }
-        }
-        
-        if (doc.containsKey("mode")) {
-          String newMode = doc["mode"].as<String>();
-          if (newMode != hvacSettings.mode) {
-            hvacSettings.mode = newMode;
-            changed = true;
-          }
-        }
-        
-        if (doc.containsKey("fan_speed")) {
-          String newFanSpeed = doc["fan_speed"].as<String>();
-          if (newFanSpeed != hvacSettings.fanSpeed) {
-            hvacSettings.fanSpeed = newFanSpeed;
-            changed = true;
-          }
-        }
-        
-        if (doc.containsKey("timer")) {
-          int newTimer = doc["timer"];
-          if (newTimer != hvacSettings.timer) {
-            hvacSettings.timer = newTimer;
-            changed = true;
-          }
-        }
-        
-        if (doc.containsKey("swing")) {
-          String newSwing = doc["swing"].as<String>();
-          if (newSwing != hvacSettings.swing) {
-            hvacSettings.swing = newSwing;
-            changed = true;
-          }
-        }
-        
-        if (changed) {
-          Serial.println("Settings updated from web");
-          hvacSettings.source = "web";
-          needsACUpdate = true;
-          settingsChanged = true;
-          // Immediately forward to Arduino for near-instant UI sync
-          sendToArduino();
-        }
-      }
+    if (!error) {
+      applyServerCommand(doc.as<JsonObjectConst>());
     }
   }
   
   http.end();
 }
 
-void checkSchedule() {
-  if (WiFi.status() != WL_CONNECTED) {
+void applyServerCommand(JsonObjectConst doc) {
+  if (doc["version"].is<uint32_t>()) {
+    commandVersion = doc["version"].as<uint32_t>();
+  }
+  
+  // Only process if changes came from web
+  uint8_t source;
+  if (!parseSource(doc["source"].as<const char*>(), source) || source != SOURCE_WEB) {
     return;
   }
   
-  HTTPClient http;
+  if (readSettingsJson(doc, hvacSettings, kServerJsonKeys)) {
+    LOG_INFO("Settings updated from web");
+    startTrace(commandVersion);
+    settingsSource = SOURCE_WEB;
+    needsACUpdate = true;
+    settingsChanged = true;
+    // Immediately forward to Arduino for near-instant UI sync
+    sendToArduino();
+  }
+}
+
+#if LOG_LEVEL > LOG_LEVEL_NONE
+// Log clock and text sink for hub_log.h
+uint32_t logClock() {
+  return millis();
+}
+
+void logText(uint8_t level, const char* fmt, ...) {
+  if (!logLimiter.allow(millis())) {
+    return;  // Still in logRing
+  }
+  if (logLimiter.dropped > 0) {
+    logSerial.printf("(%lu lines dropped)\n", (unsigned long)logLimiter.dropped);
+    logLimiter.dropped = 0;
+  }
+  char text[160];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(text, sizeof(text), fmt, args);
+  va_end(args);
+  unsigned long now = millis();
+  logSerial.printf("[%6lu.%03lu] %c %s\n", now / 1000, now % 1000, logLevelChar(level), text);
+}
+#endif
+
+#ifdef HUB_SERIAL_COMMANDS
+// Returns true if line was a debug command; replies go to logSerial
+bool handleDebugCommand(const char* cmd) {
+  if (strcmp(cmd, "prof") == 0) {
+    printProfile(logSerial, profSpans, sizeof(profSpans) / sizeof(profSpans[0]),
+                 scheduler.tasks, scheduler.count);
+    logSerial.print("ir cache     hits=");
+    logSerial.print(irCache.hits);
+    logSerial.print(" misses=");
+    logSerial.println(irCache.misses);
+    return true;
+  }
+  if (strcmp(cmd, "prof reset") == 0) {
+    for (ProfileSpan* span : profSpans) {
+      span->reset();
+    }
+    scheduler.resetStats();
+    memLoop.reset();
+    logSerial.println("Profile reset");
+    return true;
+  }
+  if (strcmp(cmd, "tstat on") == 0 || strcmp(cmd, "tstat off") == 0) {
+    thermostatEnabled = strcmp(cmd, "tstat on") == 0;
+    cmd = "tstat";
+  }
+  if (strcmp(cmd, "tstat") == 0) {
+    HVACSettings target = acSettings();
+    char line[96];
+    snprintf(line, sizeof(line), "thermostat %s%s error=%d offset=%d -> %s %uC fan=%s",
+             thermostatEnabled ? "on" : "off", thermostatActive() ? "" : " (idle)",
+             thermostat.error, thermostat.offset, onOffName(target.power), target.setTemp,
+             fanName(target.fanSpeed));
+    logSerial.println(line);
+    return true;
+  }
+  if (strcmp(cmd, "link") == 0) {
+    char line[128];
+    linkBaud.format(line, sizeof(line), linkErrors());
+    logSerial.println(line);
+    return true;
+  }
+  if (strcmp(cmd, "ota") == 0) {
+    char line[96];
+    snprintf(line, sizeof(line), "firmware %s, update %s %s %lu/%lu B", FIRMWARE_VERSION,
+             otaStateNames[otaState], otaVersion, (unsigned long)otaReceived,
+             (unsigned long)otaSize);
+    logSerial.println(line);
+    return true;
+  }
+#if LOG_LEVEL > LOG_LEVEL_NONE
+  if (strcmp(cmd, "log") == 0) {
+    char line[160];
+    for (uint16_t i = 0; i < logRing.count(); i++) {
+      LogRing::format(logRing.at(i), line, sizeof(line));
+      logSerial.println(line);
+    }
+    snprintf(line, sizeof(line), "log %lu records since boot", (unsigned long)logRing.total);
+    logSerial.println(line);
+    return true;
+  }
+#endif
+  if (strcmp(cmd, "mem") == 0) {
+    char line[96];
+    memSample().format(line, sizeof(line));
+    logSerial.print("esp ");
+    logSerial.println(line);
+    if (arduinoMemValid) {
+      arduinoMem.format(line, sizeof(line));
+      logSerial.print("r4  ");
+      logSerial.println(line);
+    }
+    return true;
+  }
+  return false;
+}
+#endif // HUB_SERIAL_COMMANDS
+
+// "prof": { "<span>": [count, min, p95, max] } in microseconds
+void writeProfileJson(JsonObject prof) {
+  for (ProfileSpan* span : profSpans) {
+    JsonArray a = prof.createNestedArray(span->name);
+    a.add(span->count);
+    a.add(span->count ? span->min : 0);
+    a.add(span->percentile(95));
+    a.add(span->max);
+  }
+}
+
+MemStats memSample() {
+  MemStats m;
+  m.freeHeap = ESP.getFreeHeap();
+  m.maxFreeBlock = ESP.getMaxFreeBlockSize();
+  m.fragmentation = ESP.getHeapFragmentation();
+  m.stackFree = ESP.getFreeContStack();   // Low-water mark of loop()'s 4 KB stack
+  m.setCounts(memLoop);
+  return m;
+}
+
+// [min, mean, max] in degrees C / %RH
+void writeWindowJson(JsonArray a, const SensorWindow& w) {
+  a.add(w.min / 100.0f);
+  a.add(w.mean() / 100.0f);
+  a.add(w.max / 100.0f);
+}
+
+// "mem": { "esp": {...}, "r4": {...} }, sizes in bytes
+void writeMemJson(JsonObject obj, const MemStats& m) {
+  obj["heap"] = m.freeHeap;
+  obj["block"] = m.maxFreeBlock;
+  obj["frag"] = m.fragmentation;
+  obj["stack"] = m.stackFree;
+  obj["allocs"] = m.allocs;
+  obj["loop_allocs"] = m.loopAllocsLast;
+  obj["loop_allocs_max"] = m.loopAllocsMax;
+}
+
+void servicePushChannel() {
+  // Long-poll: the server holds each request open until settings change,
+  // so web edits arrive within one round trip without polling.
+  if (pushState == PUSH_DISABLED) {
+    return;
+  }
+  if (!wifiOnline()) {
+    pushClient.stop();
+    pushState = PUSH_IDLE;
+    pushHealthy = false;
+    return;
+  }
   
-  // Use the schedule status endpoint
-  String scheduleStatusUrl = "http://192.168.29.64:5001/api/schedule/status";
-  http.begin(wifiClient, scheduleStatusUrl);
+  unsigned long now = millis();
   
+  if (pushState == PUSH_IDLE) {
+    if ((long)(now - pushRetryAt) < 0) {
+      return;
+    }
+    if (!pushClient.connected() && !pushClient.connect(serverHost, serverPort)) {
+      pushHealthy = false;
+      pushRetryAt = now + pushRetryDelay;
+      return;
+    }
+    
+    pushClient.printf("GET %s&since=%lu&timeout=%lu HTTP/1.1\r\n"
+                      "Host: %s\r\n"
+                      "Connection: keep-alive\r\n\r\n",
+                      commandWaitPath, (unsigned long)commandVersion, pushWaitSeconds,
+                      serverHost);
+    pushRequestTime = now;
+    pushState = PUSH_WAITING;
+    pushHealthy = true;
+    return;
+  }
+  
+  // PUSH_WAITING: don't block, just check whether the answer has started
+  if (pushClient.available() > 0) {
+    readPushResponse();
+  } else if (!pushClient.connected() || now - pushRequestTime >= pushResponseTimeout) {
+    pushClient.stop();
+    pushState = PUSH_IDLE;
+    pushHealthy = false;
+    pushRetryAt = now + pushRetryDelay;
+  }
+}
+
+void readPushResponse() {
+  // The response is already arriving, so these short reads don't stall the loop
+  pushClient.setTimeout(500);
+  
+  char line[128];
+  size_t n = pushClient.readBytesUntil('\n', line, sizeof(line) - 1);
+  line[n] = '\0';
+  const char* statusStart = strchr(line, ' ');
+  int status = statusStart ? atoi(statusStart + 1) : 0;
+  
+  // Headers
+  size_t contentLength = 0;
+  bool closeAfter = false;
+  while (true) {
+    n = pushClient.readBytesUntil('\n', line, sizeof(line) - 1);
+    line[n] = '\0';
+    if (n <= 1) break;  // Blank line ("\r") ends the headers
+    
+    if (strncasecmp(line, "Content-Length:", 15) == 0) {
+      contentLength = strtoul(line + 15, nullptr, 10);
+    } else if (strncasecmp(line, "Connection: close", 17) == 0) {
+      closeAfter = true;
+    }
+  }
+  
+  // Body is read by length so the keep-alive stream stays aligned
+  static char body[512];
+  if (contentLength >= sizeof(body)) {
+    closeAfter = true;
+    contentLength = 0;
+  }
+  n = pushClient.readBytes(body, contentLength);
+  body[n] = '\0';
+  
+  pushState = PUSH_IDLE;
+  
+  if (status == 200) {
+    StaticJsonDocument<384> doc;
+    if (!deserializeJson(doc, body, DeserializationOption::Filter(commandFilter))) {
+      applyServerCommand(doc.as<JsonObjectConst>());
+    }
+  } else if (status == 404) {
+    // Older server without the push endpoint
+    LOG_WARN("Push channel not supported by server, polling instead");
+    pushState = PUSH_DISABLED;
+    pushHealthy = false;
+    closeAfter = true;
+  } else if (status != 304) {
+    pushHealthy = false;
+    pushRetryAt = millis() + pushRetryDelay;
+    closeAfter = true;
+  }
+  
+  if (closeAfter) {
+    pushClient.stop();
+  }
+}
+
+void syncSchedule() {
+  if (!wifiOnline()) {
+    scheduler.trigger(scheduleSyncTask, scheduleSyncRetry);
+    return;
+  }
+  ProfileScope scope(profSchedule);
+  
+  http.begin(wifiClient, scheduleSlotsUrl);
   int httpResponseCode = http.GET();
   
+  // {"version":3,"enabled":true,"utc_offset":19800,"slots":[[days,minute,power,setTemp],...]}
+  // (16 slots need ~1.4 KB, so keep the document off the stack)
+  static StaticJsonDocument<1536> doc;
+  DeserializationError error = DeserializationError::EmptyInput;
   if (httpResponseCode == 200) {
-    String response = http.getString();
-    
-    // Parse JSON response
-    StaticJsonDocument<512> doc;
-    DeserializationError error = deserializeJson(doc, response);
+    error = deserializeJson(doc, http.getStream(), DeserializationOption::Filter(scheduleFilter));
+  }
+  
+  // Release the shared client before sendToServer() reuses it
+  http.end();
+  
+  if (httpResponseCode != 200 || error) {
+    LOG_WARN("Schedule sync failed");
+    scheduler.trigger(scheduleSyncTask, scheduleSyncRetry);
+    return;
+  }
+  
+  HvacSchedule fresh;
+  fresh.version = doc["version"] | 0UL;
+  fresh.enabled = doc["enabled"] | false;
+  for (JsonArrayConst slot : doc["slots"].as<JsonArrayConst>()) {
+    if (!fresh.add(slot[0] | 0, slot[1] | 0, slot[2] | 0, slot[3] | 0)) {
+      LOG_WARN("Schedule slot skipped");
+    }
+  }
+  
+  // The server's zone is the one its HH:MM times are in
+  long utcOffset = doc["utc_offset"] | 0L;
+  if (!scheduleSynced || utcOffset != scheduleUtcOffset) {
+    configTime(utcOffset, 0, ntpServer);
+    scheduleUtcOffset = utcOffset;
+  }
+  
+  scheduleCatchUp = !scheduleSynced || fresh.version != schedule.version;
+  schedule = fresh;
+  scheduleSynced = true;
+  scheduleNextEdge = 0;
+  
+  LOG_INFO("Schedule synced: %u slots%s", schedule.count, schedule.enabled ? "" : " (disabled)");
+  
+  // Re-arm against the new slots
+  scheduler.trigger(scheduleTask);
+}
+
+void serviceSchedule() {
+  if (!scheduleSynced || !schedule.enabled || schedule.count == 0) {
+    return;  // The next sync re-arms
+  }
+  
+  time_t now = time(nullptr);
+  if (now < SCHEDULE_MIN_VALID_TIME) {
+    scheduler.trigger(scheduleTask, scheduleClockRetry);
+    return;
+  }
+  
+  struct tm local;
+  localtime_r(&now, &local);
+  uint32_t weekSecond = scheduleWeekSecond(local.tm_wday, local.tm_hour, local.tm_min,
+                                           local.tm_sec);
+  
+  // Apply the edge once it's due; an early or hourly wake-up only re-arms
+  if (scheduleCatchUp || (scheduleNextEdge != 0 && now >= scheduleNextEdge)) {
+    scheduleCatchUp = false;
     
-    if (!error && doc.containsKey("schedule_active")) {
-      bool scheduleActive = doc["schedule_active"];
+    uint8_t changed = schedule.applyLast(hvacSettings, weekSecond);
+    if (changed) {
+      LOG_INFO("Schedule triggered: AC %s, %u C", onOffName(hvacSettings.power),
+               hvacSettings.setTemp);
       
-      if (scheduleActive && doc.containsKey("should_be_on")) {
-        bool shouldBeOn = doc["should_be_on"];
-        String currentPower = hvacSettings.power;
-        String requiredPower = shouldBeOn ? "on" : "off";
-        
-        // Only change if different from current state
-        if (currentPower != requiredPower) {
-          Serial.print("Schedule triggered: AC should be ");
-          Serial.println(requiredPower);
-          
-          hvacSettings.power = requiredPower;
-          hvacSettings.source = "schedule";
-          needsACUpdate = true;
-          settingsChanged = true;
-          
-          // Immediately notify server and Arduino
-          sendToServer();
-          sendToArduino();
-        }
-      }
+      settingsSource = SOURCE_SCHEDULE;
+      needsACUpdate = true;
+      settingsChanged = true;
+      
+      // Notify server this pass; sendToArduino() picks up the change
+      scheduler.trigger(serverTask);
     }
   }
   
-  http.end();
+  uint32_t wait = schedule.untilNext(weekSecond);
+  scheduleNextEdge = now + wait;
+  scheduler.trigger(scheduleTask, min((unsigned long)wait * 1000UL, scheduleMaxSleep));
+}
+
+// The server's {"version", "size", "md5", "signed"} for this variant's published image
+void offerFirmware(JsonObjectConst fw) {
+  const char* version = fw["version"] | "";
+  uint32_t size = fw["size"] | 0;
+  if (otaState == OTA_OFFERED || otaState == OTA_DOWNLOADING || otaState == OTA_READY) {
+    return;
+  }
+  if (version[0] == '\0' || size == 0 || strcmp(version, FIRMWARE_VERSION) == 0) {
+    return;
+  }
+  if (otaState == OTA_FAILED && strcmp(version, otaVersion) == 0 &&
+      millis() - otaFailedAt < otaRetryDelay) {
+    return;
+  }
+  // Update.end() checks the signature itself; this only saves downloading
+  // an image that can't pass
+  if (!OTA_SIGNED_UPDATES || !(fw["signed"] | false)) {
+    static bool warned = false;
+    if (!warned) {
+      LOG_WARN("Firmware %s refused: %s", version,
+               OTA_SIGNED_UPDATES ? "image not signed" : "no signing key in this build");
+      warned = true;
+    }
+    return;
+  }
+  
+  strlcpy(otaVersion, version, sizeof(otaVersion));
+  strlcpy(otaMd5, fw["md5"] | "", sizeof(otaMd5));
+  otaSize = size;
+  otaReceived = 0;
+  otaState = OTA_OFFERED;
+  LOG_INFO("Firmware %s offered, %lu B", otaVersion, (unsigned long)otaSize);
+  scheduler.trigger(otaTask);
 }
 
-// Helper functions to convert between strings and AC library constants
-uint8_t stringToMode(String mode) {
-  if (mode == "cool") return kDaikinCool;
-  if (mode == "heat") return kDaikinHeat;
-  if (mode == "fan") return kDaikinFan;
-  if (mode == "dry") return kDaikinDry;
-  if (mode == "auto") return kDaikinAuto;
-  return kDaikinCool;  // Default
+// Runs while an update is in progress; each pass moves at most one chunk so
+// link, IR and HTTP tasks keep their turns
+void serviceOta() {
+  switch (otaState) {
+    case OTA_OFFERED:
+      startOtaDownload();
+      break;
+      
+    case OTA_DOWNLOADING:
+      continueOtaDownload();
+      break;
+      
+    case OTA_READY:
+      // Restart between commands, with the server up to date, never mid-send
+      if (acPending || needsACUpdate || millis() - acLastChange < otaQuietTime ||
+          settingsDiff(hvacSettings, postedSettings) != 0) {
+        scheduler.trigger(otaTask, 1000);
+        return;
+      }
+      LOG_INFO("Restarting into firmware %s", otaVersion);
+#if HUB_DEBUG_UART
+      logSerial.flush();
+#endif
+      ESP.restart();
+      break;
+      
+    default:
+      break;
+  }
 }
 
-uint8_t stringToFanSpeed(String speed) {
-  if (speed == "low") return kDaikinFanMin;
-  if (speed == "medium") return kDaikinFanMed;
-  if (speed == "high") return kDaikinFanMax;
-  if (speed == "auto") return kDaikinFanAuto;
-  return kDaikinFanAuto;  // Default
+void startOtaDownload() {
+  if (!wifiOnline()) {
+    scheduler.trigger(otaTask, 1000);
+    return;
+  }
+  
+  char url[128];
+  snprintf(url, sizeof(url), "%s%s" DEVICE_QUERY, firmwareUrl, AcBackend::kName);
+  otaHttp.begin(otaClient, url);
+  int code = otaHttp.GET();
+  if (code != 200 || otaHttp.getSize() != (int)otaSize) {
+    LOG_WARN("Firmware download: HTTP %d, %d B", code, otaHttp.getSize());
+    failOta("request");
+    return;
+  }
+  
+  // A gzip image is stored as-is and unpacked by the bootloader on restart
+  if (!Update.begin(otaSize)) {
+    failOta("begin");
+    return;
+  }
+  if (otaMd5[0] != '\0') {
+    Update.setMD5(otaMd5);
+  }
+  otaReceived = 0;
+  otaLastData = millis();
+  otaState = OTA_DOWNLOADING;
+  scheduler.trigger(otaTask);
 }
 
-String modeToString(uint8_t mode) {
-  switch (mode) {
-    case kDaikinCool: return "cool";
-    case kDaikinHeat: return "heat";
-    case kDaikinFan: return "fan";
-    case kDaikinDry: return "dry";
-    case kDaikinAuto: return "auto";
-    default: return "cool";
+void continueOtaDownload() {
+  unsigned long now = millis();
+  WiFiClient* stream = otaHttp.getStreamPtr();
+  int available = stream != nullptr ? stream->available() : 0;
+  
+  if (available > 0) {
+    // Only what has already arrived, so the read never waits on the network
+    uint8_t chunk[OTA_CHUNK_SIZE];
+    size_t want = min((size_t)available, sizeof(chunk));
+    want = min(want, (size_t)(otaSize - otaReceived));
+    size_t got = stream->read(chunk, want);
+    if (Update.write(chunk, got) != got) {
+      failOta("write");
+      return;
+    }
+    otaReceived += got;
+    otaLastData = now;
+  } else if (stream == nullptr || !stream->connected() || now - otaLastData >= otaStallTimeout) {
+    failOta("download");
+    return;
+  }
+  
+  if (otaReceived >= otaSize) {
+    otaHttp.end();
+    if (!Update.end()) {   // Checks the size, MD5 and signature
+      failOta("verify");
+      return;
+    }
+    otaState = OTA_READY;
+    LOG_INFO("Firmware %s written, restart pending", otaVersion);
   }
+  scheduler.trigger(otaTask);
 }
 
-String fanSpeedToString(uint8_t speed) {
-  switch (speed) {
-    case kDaikinFanMin: return "low";
-    case kDaikinFanMed: return "medium";
-    case kDaikinFanMax: return "high";
-    case kDaikinFanAuto: return "auto";
-    default: return "auto";
+void failOta(const char* stage) {
+  LOG_WARN("Firmware %s failed at %s, update error %u", otaVersion, stage,
+           (unsigned)Update.getError());
+  if (Update.isRunning()) {
+    Update.end();   // Incomplete: discards the partial image
   }
+  otaHttp.end();
+  WiFi.setSleepMode(WIFI_MODEM_SLEEP);   // Update.begin() turns modem sleep off
+  otaState = OTA_FAILED;
+  otaFailedAt = millis();
 }
 
 #endif // ESP8266
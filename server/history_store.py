@@ -0,0 +1,171 @@
+"""
+History Store - Time-indexed room condition history in SQLite
+
+Raw readings are appended to `readings` (indexed by device and time). Each
+insert also updates 1-minute and 1-hour rollup rows (count, sum, min, max),
+so long-range queries read pre-aggregated buckets instead of every raw sample.
+
+Times are Unix seconds (server clock). All access goes through one
+connection guarded by a lock.
+"""
+
+import csv
+import os
+import sqlite3
+from datetime import datetime
+from threading import Lock
+
+TIMESTAMP_FORMAT = '%Y-%m-%d %H:%M:%S'
+
+# resolution name -> rollup table and bucket width (seconds)
+ROLLUPS = {
+    '1m': ('rollup_1m', 60),
+    '1h': ('rollup_1h', 3600),
+}
+
+SCHEMA_VERSION = 2   # 2: per-device history
+
+SCHEMA = '''
+CREATE TABLE IF NOT EXISTS readings (
+    device TEXT NOT NULL,
+    ts INTEGER NOT NULL,
+    temperature REAL NOT NULL,
+    humidity REAL NOT NULL
+);
+CREATE INDEX IF NOT EXISTS readings_device_ts ON readings (device, ts);
+''' + ''.join('''
+CREATE TABLE IF NOT EXISTS %s (
+    device TEXT NOT NULL,
+    bucket INTEGER NOT NULL,
+    n INTEGER NOT NULL,
+    temp_sum REAL NOT NULL, temp_min REAL NOT NULL, temp_max REAL NOT NULL,
+    hum_sum REAL NOT NULL, hum_min REAL NOT NULL, hum_max REAL NOT NULL,
+    PRIMARY KEY (device, bucket)
+);
+''' % table for table, _ in ROLLUPS.values())
+
+ROLLUP_UPSERT = '''
+INSERT INTO %s VALUES (?, ?, 1, ?, ?, ?, ?, ?, ?)
+ON CONFLICT (device, bucket) DO UPDATE SET
+    n = n + 1,
+    temp_sum = temp_sum + excluded.temp_sum,
+    temp_min = MIN(temp_min, excluded.temp_min),
+    temp_max = MAX(temp_max, excluded.temp_max),
+    hum_sum = hum_sum + excluded.hum_sum,
+    hum_min = MIN(hum_min, excluded.hum_min),
+    hum_max = MAX(hum_max, excluded.hum_max)
+'''
+
+
+def format_ts(ts):
+    return datetime.fromtimestamp(ts).strftime(TIMESTAMP_FORMAT)
+
+
+def parse_ts(value):
+    """Unix seconds, or a 'YYYY-MM-DD HH:MM:SS' / ISO 8601 local time"""
+    try:
+        return int(float(value))
+    except ValueError:
+        return int(datetime.fromisoformat(value).timestamp())
+
+
+class HistoryStore:
+    def __init__(self, path):
+        self.lock = Lock()
+        self.db = sqlite3.connect(path, check_same_thread=False)
+        self.db.execute('PRAGMA journal_mode=WAL')
+        self.migrate()
+        self.db.executescript(SCHEMA)
+
+    def migrate(self, default_device='default'):
+        """Version 1 stores (one hub, no device column) become the default device"""
+        version = self.db.execute('PRAGMA user_version').fetchone()[0]
+        tables = {row[0] for row in self.db.execute("SELECT name FROM sqlite_master WHERE type='table'")}
+        if version < 2 and 'readings' in tables:
+            with self.db:
+                self.db.execute("ALTER TABLE readings RENAME TO readings_v1")
+                self.db.execute('DROP INDEX IF EXISTS readings_ts')
+                for table, _ in ROLLUPS.values():
+                    self.db.execute('DROP TABLE IF EXISTS %s' % table)
+            self.db.executescript(SCHEMA)
+            rows = [(ts, temp, hum) for ts, temp, hum in
+                    self.db.execute('SELECT ts, temperature, humidity FROM readings_v1')]
+            self.add(default_device, rows)
+            self.db.execute('DROP TABLE readings_v1')
+        self.db.execute('PRAGMA user_version = %d' % SCHEMA_VERSION)
+
+    def add(self, device, rows):
+        """Append [(ts, temperature, humidity), ...] for a device and update the rollups"""
+        rows = [(device, int(ts), float(temp), float(hum)) for ts, temp, hum in rows]
+        with self.lock, self.db:
+            self.db.executemany('INSERT INTO readings VALUES (?, ?, ?, ?)', rows)
+            for table, width in ROLLUPS.values():
+                self.db.executemany(ROLLUP_UPSERT % table, [
+                    (device, ts - ts % width, temp, temp, temp, hum, hum, hum)
+                    for device, ts, temp, hum in rows
+                ])
+
+    def query(self, device, since=None, until=None, limit=50, resolution='raw'):
+        """A device's rows with since <= time < until, newest first
+
+        Raw rows: {'Timestamp', 'Temperature', 'Humidity'}. Rollup rows add
+        per-bucket 'Samples' and min/max; 'Temperature'/'Humidity' are means.
+        """
+        if resolution == 'raw':
+            sql = 'SELECT ts, temperature, humidity FROM readings'
+            column = 'ts'
+        elif resolution in ROLLUPS:
+            sql = ('SELECT bucket, temp_sum / n, hum_sum / n, n, temp_min, temp_max, '
+                   'hum_min, hum_max FROM %s' % ROLLUPS[resolution][0])
+            column = 'bucket'
+        else:
+            raise ValueError('resolution must be raw, %s' % ', '.join(ROLLUPS))
+
+        where, args = ['device = ?'], [device]
+        if since is not None:
+            where.append('%s >= ?' % column)
+            args.append(since)
+        if until is not None:
+            where.append('%s < ?' % column)
+            args.append(until)
+        sql += ' WHERE ' + ' AND '.join(where)
+        sql += ' ORDER BY %s DESC LIMIT ?' % column
+        args.append(limit)
+
+        with self.lock:
+            rows = self.db.execute(sql, args).fetchall()
+
+        result = []
+        for row in rows:
+            item = {
+                'Timestamp': format_ts(row[0]),
+                'Temperature': round(row[1], 2),
+                'Humidity': round(row[2], 2),
+            }
+            if resolution != 'raw':
+                item.update({
+                    'Samples': row[3],
+                    'TemperatureMin': row[4], 'TemperatureMax': row[5],
+                    'HumidityMin': row[6], 'HumidityMax': row[7],
+                })
+            result.append(item)
+        return result
+
+    def import_csv(self, path, device):
+        """One-time import of the old sensor_data.csv; returns rows imported"""
+        with self.lock:
+            if self.db.execute('SELECT 1 FROM readings LIMIT 1').fetchone():
+                return 0
+        if not os.path.exists(path):
+            return 0
+
+        rows = []
+        with open(path, 'r') as f:
+            for row in csv.DictReader(f):
+                try:
+                    ts = datetime.strptime(row['Timestamp'], TIMESTAMP_FORMAT).timestamp()
+                    rows.append((ts, float(row['Temperature']), float(row['Humidity'])))
+                except (KeyError, TypeError, ValueError):
+                    continue   # Rows written before both readings arrived
+        self.add(device, rows)
+        return len(rows)
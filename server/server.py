@@ -1,49 +1,353 @@
-from flask import Flask, render_template, jsonify, request
-import csv
+from flask import Flask, Response, render_template, jsonify, request, abort, send_file
+import hashlib
+import json
+import math
 import os
+import queue
+import re
+import time
+from collections import OrderedDict, deque
 from datetime import datetime
-from threading import Lock
+from threading import Lock, Condition
+from history_store import HistoryStore, parse_ts
+from sign_firmware import image_signed
 
 app = Flask(__name__)
 
-# File to store data
-DATA_FILE = 'sensor_data.csv'
-csv_lock = Lock()
-
-# In-memory storage for latest values
-latest_data = {
-    'temperature': None,
-    'humidity': None,
-    'timestamp': None
-}
-
-# In-memory storage for HVAC settings
-hvac_settings = {
-    'power': None,          # on/off
-    'set_temp': None,       # target temperature
-    'mode': None,           # cool/heat/fan/dry/auto
-    'fan_speed': None,      # low/medium/high/auto
-    'timer': None,          # timer in minutes
-    'swing': None,          # swing on/off (added feature)
-    'timestamp': None
-}
-
-# Schedule settings
-schedule_settings = {
-    'enabled': False,       # whether schedule is active
-    'start_time': '23:00',  # time to turn on (24-hour format)
-    'end_time': '05:00',    # time to turn off (24-hour format)
-    'timestamp': None
-}
-
-# Initialize CSV file if it doesn't exist
-def init_csv():
-    if not os.path.exists(DATA_FILE):
-        with open(DATA_FILE, 'w', newline='') as f:
-            writer = csv.writer(f)
-            writer.writerow(['Timestamp', 'Temperature', 'Humidity'])
-
-init_csv()
+# Room condition history (see history_store.py)
+HISTORY_DB = 'sensor_history.db'
+LEGACY_CSV = 'sensor_data.csv'   # Imported once into an empty store
+HISTORY_MAX_LIMIT = 5000
+history = HistoryStore(HISTORY_DB)
+
+# Push channel: long-poll requests are held at most this long
+MAX_LONG_POLL_SECONDS = 30
+
+# HVAC fields carried in ESP telemetry (deltas may carry any subset)
+HVAC_FIELDS = ('power', 'set_temp', 'mode', 'fan_speed', 'timer', 'swing')
+
+# Command latency tracing. A web command's settings version is its ID; the
+# server stamps when it was made and first handed to the ESP, and the ESP
+# echoes its own stage times (ms after receipt) back in telemetry.
+MAX_TRACKED_COMMANDS = 64
+LATENCY_SAMPLES = 256
+LATENCY_HOPS = (
+    'server_queue',   # web update -> first delivery to the ESP
+    'esp_ir',         # ESP receipt -> IR sent
+    'esp_link',       # ESP receipt -> forwarded to the Arduino
+    'r4_display',     # ESP receipt -> Arduino shows it (binary link only)
+    'web_to_ir',      # server_queue + esp_ir (excludes one-way HTTP transit)
+)
+
+# Hubs name themselves with ?device=<id>; requests without one use the
+# default device, so single-hub setups and old firmware keep working.
+DEFAULT_DEVICE = 'default'
+DEVICE_ID_PATTERN = re.compile(r'^[A-Za-z0-9_-]{1,32}$')
+MAX_DEVICES = 256
+
+# Heap and stack health the hub posts with each keyframe ('mem', one entry
+# per board). Samples are kept so slow leaks show up as a falling trend.
+MEMORY_SAMPLES = 120           # Two hours of once-a-minute keyframes
+MEMORY_WARN_FRAGMENTATION = 50 # percent
+MEMORY_WARN_STACK = 512        # bytes of stack never touched
+MEMORY_WARN_HEAP_DROP = 1024   # bytes lost between the older and newer half of the samples
+MEMORY_FIELDS = ('heap', 'block', 'frag', 'stack', 'allocs', 'loop_allocs', 'loop_allocs_max')
+
+# Hub firmware updates. FIRMWARE_DIR holds the manifest and the images it
+# names, one build per AC variant, e.g.
+#   {"version": "1.2.0", "images": {"daikin": "hub-daikin.bin.gz"}}
+# Images may be gzip-compressed; the ESP8266 bootloader unpacks them. A hub
+# whose keyframe reports another version is offered the image in the reply.
+# Images must be signed (see sign_firmware.py): the hub boots nothing else,
+# and unsigned ones are neither offered nor served.
+FIRMWARE_DIR = 'firmware_images'
+FIRMWARE_MANIFEST = 'hub.json'
+
+# Dashboard push (Server-Sent Events): each open page holds one stream
+EVENT_QUEUE_SIZE = 32          # Events buffered per page before it's dropped
+EVENT_KEEPALIVE_SECONDS = 15   # Comment line on idle streams; also detects closed pages
+
+class Device:
+    """All server state for one hub
+    
+    `lock` guards every field and `command_cond` (sharing that lock) wakes
+    the hub's long-poll, so rooms never contend with each other.
+    """
+    
+    def __init__(self, device_id):
+        self.id = device_id
+        self.lock = Lock()
+        self.command_cond = Condition(self.lock)
+        self.last_seen = None
+        
+        # Latest room conditions. The hub only sends values that moved past
+        # its deadband; 'window' is the min/mean/max of every smoothed reading
+        # over the last keyframe interval: {'n', 'temperature', 'humidity'}
+        self.latest_data = {
+            'temperature': None,
+            'humidity': None,
+            'window': None,
+            'timestamp': None
+        }
+        
+        # HVAC settings
+        self.hvac_settings = {
+            'power': None,          # on/off
+            'set_temp': None,       # target temperature
+            'mode': None,           # cool/heat/fan/dry/auto
+            'fan_speed': None,      # low/medium/high/auto
+            'timer': None,          # timer in minutes
+            'swing': None,          # swing on/off (added feature)
+            'timestamp': None,
+            'version': 0            # bumped on every web change (push channel)
+        }
+        
+        # Schedule settings
+        self.schedule_settings = {
+            'enabled': False,       # whether schedule is active
+            'start_time': '23:00',  # time to turn on (24-hour format)
+            'end_time': '05:00',    # time to turn off (24-hour format)
+            # Weekly slots; when empty, start/end above act as a daily on/off pair.
+            # Each slot: {'days': ['mon', ...], 'time': 'HH:MM', 'power': 'on'|'off'|None,
+            #             'set_temp': int|None}
+            'slots': [],
+            'version': 1,           # bumped on every change; the ESP re-syncs when it moves
+            'timestamp': None
+        }
+        
+        # Delta sync state: last telemetry sequence number seen from the ESP
+        self.sync_state = {
+            'last_seq': None
+        }
+        
+        # Command latency tracing (see LATENCY_HOPS)
+        self.command_traces = OrderedDict()   # version -> {'web': ms, 'delivered': ms}
+        self.latency_samples = {hop: deque(maxlen=LATENCY_SAMPLES) for hop in LATENCY_HOPS}
+        
+        # Latest ESP timing stats: {span: [count, min_us, p95_us, max_us]}
+        self.profile = {
+            'spans': {},
+            'timestamp': None
+        }
+        
+        # What the hub's thermostat last sent the AC ('power', 'set_temp',
+        # 'fan_speed', plus 'error'/'offset' in C); None while it's idle
+        self.thermostat = None
+        
+        # Hub's serial link to the Arduino: 'baud' and its receive error
+        # counters since boot ('crc', 'overruns', 'gaps', 'fallbacks', ...)
+        self.link = None
+        
+        # Hub firmware from keyframes: {'version', 'variant'}, and the update
+        # in progress if any: {'version', 'state', 'received', 'size'}
+        self.firmware = None
+        self.ota = None
+        
+        # Latest heap/stack stats per board ('esp', 'r4') and their history
+        self.memory = {
+            'boards': {},
+            'timestamp': None
+        }
+        self.memory_samples = deque(maxlen=MEMORY_SAMPLES)
+        
+        # Event queues of the dashboards streaming this device
+        self.subscribers = []
+
+devices = {}            # device id -> Device
+devices_lock = Lock()   # Only guards the dict itself
+
+def get_device():
+    """The Device named by the request's ?device= argument, created on first use"""
+    device_id = request.args.get('device', DEFAULT_DEVICE)
+    if not DEVICE_ID_PATTERN.match(device_id):
+        abort(400, 'device must be 1-32 letters, digits, - or _')
+    with devices_lock:
+        device = devices.get(device_id)
+        if device is None:
+            if len(devices) >= MAX_DEVICES:
+                abort(503, 'Too many devices')
+            device = devices[device_id] = Device(device_id)
+    return device
+
+# Slot day names in the ESP's bit order (bit 0 = Sunday, as in struct tm)
+SCHEDULE_DAYS = ['sun', 'mon', 'tue', 'wed', 'thu', 'fri', 'sat']
+SCHEDULE_MAX_SLOTS = 16
+SCHEDULE_POWER_CODES = {'off': 0, 'on': 1, None: 2}   # 2 = leave power alone
+
+imported = history.import_csv(LEGACY_CSV, DEFAULT_DEVICE)
+if imported:
+    print('Imported %d rows from %s' % (imported, LEGACY_CSV))
+
+def now_ms():
+    return time.monotonic() * 1000.0
+
+# The helpers below take a Device and expect its lock to be held
+
+def publish_command(device):
+    """Bump the command version and wake the device's waiting long-poll"""
+    device.hvac_settings['version'] += 1
+    trace_command_created(device, device.hvac_settings['version'])
+    device.command_cond.notify_all()
+
+def format_event(event, data):
+    return 'event: %s\ndata: %s\n\n' % (event, json.dumps(data))
+
+def publish_event(device, event, data):
+    """Send one event to every dashboard streaming the device
+    
+    A page that stops reading fills its queue and is cut off; its
+    EventSource reconnects and starts from a fresh snapshot.
+    """
+    message = format_event(event, data)
+    for subscriber in list(device.subscribers):
+        try:
+            subscriber.put_nowait(message)
+        except queue.Full:
+            # Drop the page's backlog and end its stream
+            device.subscribers.remove(subscriber)
+            try:
+                while True:
+                    subscriber.get_nowait()
+            except queue.Empty:
+                pass
+            subscriber.put_nowait(None)
+
+def trace_command_created(device, version):
+    traces = device.command_traces
+    traces[version] = {'web': now_ms(), 'delivered': None}
+    while len(traces) > MAX_TRACKED_COMMANDS:
+        traces.popitem(last=False)
+
+def trace_command_delivered(device, version):
+    """Stamp the first time a command goes out to the ESP"""
+    entry = device.command_traces.get(version)
+    if entry is not None and entry['delivered'] is None:
+        entry['delivered'] = now_ms()
+
+def record_trace(device, trace):
+    """Turn the ESP's stage times for one command into per-hop samples"""
+    samples = device.latency_samples
+    entry = device.command_traces.pop(trace.get('id'), None)
+    queued_ms = None
+    if entry is not None and entry['delivered'] is not None:
+        queued_ms = entry['delivered'] - entry['web']
+        samples['server_queue'].append(queued_ms)
+    for hop, key in (('esp_ir', 'ir'), ('esp_link', 'link'), ('r4_display', 'display')):
+        if key in trace:
+            samples[hop].append(float(trace[key]))
+    if queued_ms is not None and 'ir' in trace:
+        samples['web_to_ir'].append(queued_ms + float(trace['ir']))
+
+def percentile(sorted_values, pct):
+    """Nearest-rank percentile of an already sorted list"""
+    rank = max(1, int(math.ceil(pct / 100.0 * len(sorted_values))))
+    return sorted_values[rank - 1]
+
+def record_memory(device, mem, timestamp):
+    """Store one keyframe's {'esp': {...}, 'r4': {...}} memory stats"""
+    boards = {}
+    for board, stats in mem.items():
+        if isinstance(stats, dict):
+            boards[board] = {field: stats[field] for field in MEMORY_FIELDS if field in stats}
+    device.memory['boards'] = boards
+    device.memory['timestamp'] = timestamp
+    device.memory_samples.append({'timestamp': timestamp, 'boards': boards})
+
+def memory_warnings(device):
+    """Human-readable problems in the latest memory stats"""
+    warnings = []
+    for board, stats in sorted(device.memory['boards'].items()):
+        if stats.get('frag', 0) >= MEMORY_WARN_FRAGMENTATION:
+            warnings.append('%s: heap %d%% fragmented' % (board, stats['frag']))
+        if 'stack' in stats and stats['stack'] < MEMORY_WARN_STACK:
+            warnings.append('%s: only %d bytes of stack left' % (board, stats['stack']))
+        if stats.get('loop_allocs_max', 0) > 0:
+            warnings.append('%s: up to %d allocations in one loop pass' %
+                            (board, stats['loop_allocs_max']))
+        
+        # A leak shows as a steady fall in free heap across the history
+        heaps = [sample['boards'][board]['heap'] for sample in device.memory_samples
+                 if 'heap' in sample['boards'].get(board, {})]
+        if len(heaps) >= 10:
+            half = len(heaps) // 2
+            older = sum(heaps[:half]) / float(half)
+            newer = sum(heaps[half:]) / float(len(heaps) - half)
+            if older - newer > MEMORY_WARN_HEAP_DROP:
+                warnings.append('%s: free heap falling (%d -> %d bytes)' %
+                                (board, older, newer))
+    return warnings
+
+def parse_schedule_slot(slot):
+    """Validate one slot from the web; raises ValueError"""
+    days = slot.get('days', SCHEDULE_DAYS)
+    if not days or any(day not in SCHEDULE_DAYS for day in days):
+        raise ValueError('days must be a non-empty list of %s' % ', '.join(SCHEDULE_DAYS))
+    datetime.strptime(slot['time'], '%H:%M')
+    power = slot.get('power')
+    if power not in SCHEDULE_POWER_CODES:
+        raise ValueError("power must be 'on', 'off' or null")
+    set_temp = slot.get('set_temp')
+    if set_temp is not None:
+        set_temp = int(set_temp)
+        if not 16 <= set_temp <= 30:
+            raise ValueError('set_temp must be 16-30')
+    if power is None and set_temp is None:
+        raise ValueError('slot must set power or set_temp')
+    return {'days': [day for day in SCHEDULE_DAYS if day in days], 'time': slot['time'],
+            'power': power, 'set_temp': set_temp}
+
+def schedule_slots(schedule_settings):
+    """Effective slots: the weekly list, or the legacy start/end pair"""
+    if schedule_settings['slots']:
+        return schedule_settings['slots']
+    return [
+        {'days': SCHEDULE_DAYS, 'time': schedule_settings['start_time'], 'power': 'on', 'set_temp': None},
+        {'days': SCHEDULE_DAYS, 'time': schedule_settings['end_time'], 'power': 'off', 'set_temp': None},
+    ]
+
+firmware_digests = {}    # image path -> (mtime, md5 hex, signed)
+firmware_lock = Lock()
+
+def firmware_image(variant):
+    """The published, signed image for an AC variant:
+    {'version', 'path', 'size', 'md5', 'signed'}, or None
+    """
+    try:
+        with open(os.path.join(FIRMWARE_DIR, FIRMWARE_MANIFEST)) as f:
+            manifest = json.load(f)
+        name = manifest['images'][variant]
+        path = os.path.join(FIRMWARE_DIR, os.path.basename(name))
+        stat = os.stat(path)
+        version = str(manifest['version'])
+    except (OSError, ValueError, KeyError, TypeError):
+        return None
+    
+    # Hash each image once per change on disk
+    with firmware_lock:
+        cached = firmware_digests.get(path)
+        if cached is None or cached[0] != stat.st_mtime:
+            md5 = hashlib.md5()
+            with open(path, 'rb') as f:
+                for block in iter(lambda: f.read(65536), b''):
+                    md5.update(block)
+            cached = firmware_digests[path] = (stat.st_mtime, md5.hexdigest(),
+                                               image_signed(path, stat.st_size))
+    if not cached[2]:
+        return None
+    return {'version': version, 'path': path, 'size': stat.st_size, 'md5': cached[1],
+            'signed': True}
+
+def command_response(device):
+    """Current settings with an ETag so unchanged polls cost a 304"""
+    hvac_settings = device.hvac_settings
+    etag = 'v%d' % hvac_settings['version']
+    if request.if_none_match.contains(etag):
+        response = app.response_class(status=304)
+    else:
+        trace_command_delivered(device, hvac_settings['version'])
+        response = jsonify(hvac_settings)
+    response.set_etag(etag)
+    return response
 
 @app.route('/')
 def index():
@@ -57,134 +361,435 @@ def control():
 
 @app.route('/api/data', methods=['POST'])
 def receive_data():
-    """Receive data from ESP8266"""
+    """Receive data from ESP8266
+
+    Full updates (keyframes, or any payload without a 'seq') must carry
+    temperature and humidity. Deltas carry a 'seq' and only the changed
+    fields; a gap in 'seq' asks the ESP for a keyframe via 'resync'.
+    If 'cmd_version' is behind, the current settings ride back as 'command'.
+    'schedule_version' tells the ESP when to re-fetch /api/schedule/slots.
+    Keyframe replies carry 'firmware' when another build is published for
+    the hub's variant (see FIRMWARE_MANIFEST).
+    """
+    device = get_device()
     try:
         data = request.get_json()
+        is_delta = 'seq' in data and not data.get('keyframe', False)
         temperature = data.get('temperature')
         humidity = data.get('humidity')
         
-        if temperature is None or humidity is None:
+        if not is_delta and (temperature is None or humidity is None):
             return jsonify({'error': 'Missing temperature or humidity'}), 400
         
         timestamp = datetime.now().strftime('%Y-%m-%d %H:%M:%S')
+        reading = None
+        
+        with device.lock:
+            device.last_seen = timestamp
+            latest_data = device.latest_data
+            hvac_settings = device.hvac_settings
+            
+            # Detect lost deltas
+            resync = False
+            if 'seq' in data:
+                seq = int(data['seq'])
+                last_seq = device.sync_state['last_seq']
+                if is_delta and (last_seq is None or seq != (last_seq + 1) % 65536):
+                    resync = True
+                device.sync_state['last_seq'] = seq
+            
+            # Update latest data
+            has_conditions = temperature is not None or humidity is not None
+            if 'window' in data:
+                latest_data['window'] = data['window']
+            if temperature is not None:
+                latest_data['temperature'] = temperature
+            if humidity is not None:
+                latest_data['humidity'] = humidity
+            if has_conditions:
+                latest_data['timestamp'] = timestamp
+                publish_event(device, 'current', latest_data)
+                if None not in (latest_data['temperature'], latest_data['humidity']):
+                    reading = (time.time(), latest_data['temperature'], latest_data['humidity'])
+                    publish_event(device, 'history', {
+                        'Timestamp': timestamp,
+                        'Temperature': latest_data['temperature'],
+                        'Humidity': latest_data['humidity']
+                    })
+            
+            # Update HVAC settings if provided
+            if 'hvac' in data:
+                hvac = data['hvac']
+                for field in HVAC_FIELDS:
+                    if field in hvac:
+                        hvac_settings[field] = hvac[field]
+                hvac_settings['timestamp'] = timestamp
+                # Mark origin so ESP doesn't re-apply stale web commands
+                hvac_settings['source'] = 'arduino'
+                publish_event(device, 'hvac', hvac_settings)
+            
+            # Stage times for a traced web command
+            if 'trace' in data:
+                record_trace(device, data['trace'])
+            
+            # Timing stats ride along with keyframes
+            if 'prof' in data:
+                device.profile['spans'] = data['prof']
+                device.profile['timestamp'] = timestamp
+            if 'mem' in data:
+                record_memory(device, data['mem'], timestamp)
+            if data.get('keyframe'):
+                device.thermostat = data.get('thermostat')
+                if 'link' in data:
+                    device.link = data['link']
+                if 'fw' in data:
+                    device.firmware = data['fw']
+                device.ota = data.get('ota')
+            
+            response = {'status': 'success', 'timestamp': timestamp,
+                        'schedule_version': device.schedule_settings['version']}
+            if resync:
+                response['resync'] = True
+            # Piggyback newer settings so the ESP can skip a separate command GET
+            if 'cmd_version' in data and int(data['cmd_version']) != hvac_settings['version']:
+                trace_command_delivered(device, hvac_settings['version'])
+                response['command'] = dict(hvac_settings)
+            firmware = device.firmware if data.get('keyframe') else None
+        
+        # Offer the published build to a hub running something else
+        if isinstance(firmware, dict):
+            image = firmware_image(firmware.get('variant'))
+            if image is not None and image['version'] != firmware.get('version'):
+                response['firmware'] = {k: image[k] for k in ('version', 'size', 'md5', 'signed')}
         
-        # Update latest data
-        latest_data['temperature'] = temperature
-        latest_data['humidity'] = humidity
-        latest_data['timestamp'] = timestamp
-        
-        # Update HVAC settings if provided
-        if 'hvac' in data:
-            hvac = data['hvac']
-            hvac_settings['power'] = hvac.get('power')
-            hvac_settings['set_temp'] = hvac.get('set_temp')
-            hvac_settings['mode'] = hvac.get('mode')
-            hvac_settings['fan_speed'] = hvac.get('fan_speed')
-            hvac_settings['timer'] = hvac.get('timer')
-            hvac_settings['swing'] = hvac.get('swing')
-            hvac_settings['timestamp'] = timestamp
-            # Mark origin so ESP doesn't re-apply stale web commands
-            hvac_settings['source'] = 'arduino'
-        
-        # Save to CSV (this happens every 15 seconds from ESP8266)
-        with csv_lock:
-            with open(DATA_FILE, 'a', newline='') as f:
-                writer = csv.writer(f)
-                writer.writerow([timestamp, temperature, humidity])
-        
-        return jsonify({'status': 'success', 'timestamp': timestamp}), 200
+        # Record history whenever the room conditions changed
+        if reading is not None:
+            history.add(device.id, [reading])
+        
+        return jsonify(response), 200
     
     except Exception as e:
         return jsonify({'error': str(e)}), 500
 
+@app.route('/api/data/batch', methods=['POST'])
+def receive_batch():
+    """Receive readings the ESP8266 buffered while it was offline
+    
+    Body: {'now': <esp millis>, 'samples': [[<esp millis>, temp_centi, humidity_centi], ...]}
+    Sample times are converted to wall-clock time relative to 'now'.
+    """
+    device = get_device()
+    try:
+        data = request.get_json()
+        esp_now = int(data['now'])
+        received = time.time()
+        
+        rows = []
+        for t, temp, humidity in data.get('samples', []):
+            age_ms = (esp_now - int(t)) % 2**32   # millis() wraps at 32 bits
+            rows.append((received - age_ms / 1000.0,
+                         round(temp / 100.0, 2), round(humidity / 100.0, 2)))
+        history.add(device.id, rows)
+        
+        # Backfilled rows land in the middle of the history; pages re-fetch it
+        with device.lock:
+            publish_event(device, 'history', {'backfill': len(rows)})
+        
+        return jsonify({'status': 'success', 'accepted': len(rows)}), 200
+    
+    except Exception as e:
+        return jsonify({'error': str(e)}), 500
+
+@app.route('/api/devices', methods=['GET'])
+def get_devices():
+    """Every hub's conditions and settings in one request (dashboard overview)"""
+    with devices_lock:
+        snapshot = list(devices.values())
+    
+    rooms = {}
+    for device in snapshot:
+        with device.lock:
+            rooms[device.id] = {
+                'current': dict(device.latest_data),
+                'hvac': dict(device.hvac_settings),
+                'schedule_enabled': device.schedule_settings['enabled'],
+                'thermostat': device.thermostat,
+                'link': device.link,
+                'firmware': device.firmware,
+                'ota': device.ota,
+                'memory': memory_warnings(device),
+                'last_seen': device.last_seen
+            }
+    return jsonify(rooms)
+
+@app.route('/api/events', methods=['GET'])
+def stream_events():
+    """Server-Sent Events stream of one device for the dashboard pages
+    
+    Starts with a snapshot ('current', 'hvac', 'schedule'), then sends each
+    change as receive_data() / update_hvac() / update_schedule() handle it:
+        current   latest conditions
+        hvac      settings
+        schedule  schedule settings
+        history   a new reading row, or {'backfill': n} after a batch upload
+    """
+    device = get_device()
+    subscriber = queue.Queue(maxsize=EVENT_QUEUE_SIZE)
+    with device.lock:
+        for event, data in (('current', device.latest_data), ('hvac', device.hvac_settings),
+                            ('schedule', device.schedule_settings)):
+            subscriber.put_nowait(format_event(event, data))
+        device.subscribers.append(subscriber)
+    
+    def stream():
+        try:
+            while True:
+                try:
+                    message = subscriber.get(timeout=EVENT_KEEPALIVE_SECONDS)
+                except queue.Empty:
+                    message = ': keepalive\n\n'
+                if message is None:
+                    return
+                yield message
+        finally:
+            # Page closed (the next write after it went away raises here)
+            with device.lock:
+                if subscriber in device.subscribers:
+                    device.subscribers.remove(subscriber)
+    
+    return Response(stream(), mimetype='text/event-stream',
+                    headers={'Cache-Control': 'no-cache', 'X-Accel-Buffering': 'no'})
+
 @app.route('/api/current', methods=['GET'])
 def get_current():
-    """Get current sensor values (called every 5 seconds from webpage)"""
-    return jsonify(latest_data)
+    """Get current sensor values (pages get changes from /api/events)"""
+    device = get_device()
+    with device.lock:
+        return jsonify(device.latest_data)
+
+@app.route('/api/profile', methods=['GET'])
+def get_profile():
+    """Get the ESP's latest loop/task timing stats"""
+    device = get_device()
+    with device.lock:
+        return jsonify(device.profile)
+
+@app.route('/api/memory', methods=['GET'])
+def get_memory():
+    """Heap, fragmentation and stack stats per board, with warnings
+    
+    ?samples=1 adds the recent history, oldest first.
+    """
+    device = get_device()
+    with device.lock:
+        result = dict(device.memory)
+        result['warnings'] = memory_warnings(device)
+        if request.args.get('samples'):
+            result['samples'] = list(device.memory_samples)
+    return jsonify(result)
+
+@app.route('/api/latency', methods=['GET'])
+def get_latency():
+    """Per-hop web command latency percentiles in milliseconds"""
+    device = get_device()
+    hops = {}
+    with device.lock:
+        for hop in LATENCY_HOPS:
+            values = sorted(device.latency_samples[hop])
+            if not values:
+                hops[hop] = {'count': 0, 'p50': None, 'p95': None, 'p99': None}
+                continue
+            hops[hop] = {
+                'count': len(values),
+                'p50': round(percentile(values, 50), 1),
+                'p95': round(percentile(values, 95), 1),
+                'p99': round(percentile(values, 99), 1),
+            }
+    return jsonify({'hops': hops, 'window': LATENCY_SAMPLES})
 
 @app.route('/api/hvac', methods=['GET'])
 def get_hvac():
     """Get current HVAC settings"""
-    return jsonify(hvac_settings)
+    device = get_device()
+    with device.lock:
+        return jsonify(device.hvac_settings)
 
 @app.route('/api/hvac/update', methods=['POST'])
 def update_hvac():
     """Update HVAC settings from web control"""
+    device = get_device()
     try:
         data = request.get_json()
         
-        # Update settings
-        if 'power' in data:
-            hvac_settings['power'] = data['power']
+        # Validate before touching the settings
         if 'set_temp' in data:
-            # Validate temperature range
             temp = int(data['set_temp'])
-            if 16 <= temp <= 30:
-                hvac_settings['set_temp'] = temp
-            else:
+            if not 16 <= temp <= 30:
                 return jsonify({'error': 'Temperature must be between 16°C and 30°C'}), 400
-        if 'mode' in data:
-            hvac_settings['mode'] = data['mode']
-        if 'fan_speed' in data:
-            hvac_settings['fan_speed'] = data['fan_speed']
-        if 'timer' in data:
-            hvac_settings['timer'] = data['timer']
-        if 'swing' in data:
-            hvac_settings['swing'] = data['swing']
-        
-        hvac_settings['timestamp'] = datetime.now().strftime('%Y-%m-%d %H:%M:%S')
-        hvac_settings['source'] = 'web'  # Mark that change came from web
         
-        return jsonify({'status': 'success', 'settings': hvac_settings}), 200
+        with device.lock:
+            hvac_settings = device.hvac_settings
+            
+            # Update settings
+            if 'power' in data:
+                hvac_settings['power'] = data['power']
+            if 'set_temp' in data:
+                hvac_settings['set_temp'] = int(data['set_temp'])
+            if 'mode' in data:
+                hvac_settings['mode'] = data['mode']
+            if 'fan_speed' in data:
+                hvac_settings['fan_speed'] = data['fan_speed']
+            if 'timer' in data:
+                hvac_settings['timer'] = data['timer']
+            if 'swing' in data:
+                hvac_settings['swing'] = data['swing']
+            
+            hvac_settings['timestamp'] = datetime.now().strftime('%Y-%m-%d %H:%M:%S')
+            hvac_settings['source'] = 'web'  # Mark that change came from web
+            
+            # Push to the ESP8266 and open dashboards immediately
+            publish_command(device)
+            publish_event(device, 'hvac', hvac_settings)
+            
+            return jsonify({'status': 'success', 'settings': hvac_settings}), 200
     
     except Exception as e:
         return jsonify({'error': str(e)}), 500
 
 @app.route('/api/hvac/command', methods=['GET'])
 def get_hvac_command():
-    """ESP8266 polls this endpoint to get settings (for control from web)"""
-    return jsonify(hvac_settings)
+    """ESP8266 polls this endpoint to get settings (fallback when push is down)"""
+    device = get_device()
+    with device.lock:
+        return command_response(device)
+
+@app.route('/api/hvac/command/wait', methods=['GET'])
+def wait_hvac_command():
+    """Push channel: ESP8266 long-polls until the settings version changes
+    
+    Query args:
+        device: hub ID
+        since: last version the ESP has seen
+        timeout: seconds to hold the request open (capped)
+    
+    Returns the settings as soon as the version differs from 'since' (also
+    after a server restart resets it), or 304 when the timeout expires.
+    """
+    device = get_device()
+    since = request.args.get('since', 0, type=int)
+    timeout = min(request.args.get('timeout', 25, type=float), MAX_LONG_POLL_SECONDS)
+    
+    with device.command_cond:
+        changed = device.command_cond.wait_for(
+            lambda: device.hvac_settings['version'] != since, timeout=timeout)
+        if not changed:
+            return '', 304
+        return command_response(device)
 
 @app.route('/api/schedule', methods=['GET'])
 def get_schedule():
     """Get current schedule settings"""
-    return jsonify(schedule_settings)
+    device = get_device()
+    with device.lock:
+        return jsonify(device.schedule_settings)
 
 @app.route('/api/schedule/update', methods=['POST'])
 def update_schedule():
     """Update schedule settings from web"""
+    device = get_device()
     try:
         data = request.get_json()
         
-        if 'enabled' in data:
-            schedule_settings['enabled'] = bool(data['enabled'])
+        # Validate everything first so a bad field leaves the schedule untouched
         if 'start_time' in data:
             # Validate time format (HH:MM)
             try:
                 datetime.strptime(data['start_time'], '%H:%M')
-                schedule_settings['start_time'] = data['start_time']
             except ValueError:
                 return jsonify({'error': 'Invalid start_time format. Use HH:MM (24-hour)'}), 400
         if 'end_time' in data:
             # Validate time format (HH:MM)
             try:
                 datetime.strptime(data['end_time'], '%H:%M')
-                schedule_settings['end_time'] = data['end_time']
             except ValueError:
                 return jsonify({'error': 'Invalid end_time format. Use HH:MM (24-hour)'}), 400
+        slots = None
+        if 'slots' in data:
+            if len(data['slots']) > SCHEDULE_MAX_SLOTS:
+                return jsonify({'error': 'At most %d slots' % SCHEDULE_MAX_SLOTS}), 400
+            try:
+                slots = [parse_schedule_slot(slot) for slot in data['slots']]
+            except (KeyError, TypeError, ValueError) as e:
+                return jsonify({'error': 'Invalid slot: %s' % e}), 400
         
-        schedule_settings['timestamp'] = datetime.now().strftime('%Y-%m-%d %H:%M:%S')
-        
-        return jsonify({'status': 'success', 'schedule': schedule_settings}), 200
+        with device.lock:
+            schedule_settings = device.schedule_settings
+            if 'enabled' in data:
+                schedule_settings['enabled'] = bool(data['enabled'])
+            if 'start_time' in data:
+                schedule_settings['start_time'] = data['start_time']
+            if 'end_time' in data:
+                schedule_settings['end_time'] = data['end_time']
+            if slots is not None:
+                schedule_settings['slots'] = slots
+            
+            schedule_settings['version'] += 1
+            schedule_settings['timestamp'] = datetime.now().strftime('%Y-%m-%d %H:%M:%S')
+            publish_event(device, 'schedule', schedule_settings)
+            
+            return jsonify({'status': 'success', 'schedule': schedule_settings}), 200
     
     except Exception as e:
         return jsonify({'error': str(e)}), 500
 
+@app.route('/api/firmware/<variant>', methods=['GET'])
+def get_firmware(variant):
+    """Hub firmware image for an AC variant, as offered in /api/data replies
+
+    Unauthenticated, like the rest of the hub API, and plain HTTP: anyone on
+    the network can fetch the image or tamper with it in transit. The hub's
+    check of the image's signature is what keeps a modified one from booting.
+    """
+    image = firmware_image(variant)
+    if image is None:
+        abort(404)
+    return send_file(image['path'], mimetype='application/octet-stream', max_age=0)
+
+@app.route('/api/schedule/slots', methods=['GET'])
+def get_schedule_slots():
+    """Compact schedule for the ESP8266, which evaluates it locally
+    
+    slots: [[day_mask, minute_of_day, power (0 off, 1 on, 2 keep), set_temp (0 keep)], ...]
+    utc_offset: seconds east of UTC for the server's zone, which the times are in
+    """
+    device = get_device()
+    with device.lock:
+        schedule_settings = device.schedule_settings
+        slots = []
+        for slot in schedule_slots(schedule_settings):
+            mask = sum(1 << SCHEDULE_DAYS.index(day) for day in slot['days'])
+            hour, minute = map(int, slot['time'].split(':'))
+            slots.append([mask, hour * 60 + minute, SCHEDULE_POWER_CODES[slot['power']],
+                          slot['set_temp'] or 0])
+        
+        return jsonify({
+            'version': schedule_settings['version'],
+            'enabled': schedule_settings['enabled'],
+            'utc_offset': time.localtime().tm_gmtoff,
+            'slots': slots
+        })
+
 @app.route('/api/schedule/status', methods=['GET'])
 def get_schedule_status():
     """Check if AC should be on or off based on schedule"""
+    device = get_device()
     try:
-        if not schedule_settings['enabled']:
+        with device.lock:
+            enabled = device.schedule_settings['enabled']
+            start = device.schedule_settings['start_time']
+            end = device.schedule_settings['end_time']
+        
+        if not enabled:
             return jsonify({
                 'schedule_active': False,
                 'should_be_on': None,
@@ -194,9 +799,6 @@ def get_schedule_status():
         now = datetime.now()
         current_time = now.strftime('%H:%M')
         
-        start = schedule_settings['start_time']
-        end = schedule_settings['end_time']
-        
         # Handle overnight schedules (e.g., 23:00 to 05:00)
         if start > end:
             # Overnight schedule
@@ -218,19 +820,26 @@ def get_schedule_status():
 
 @app.route('/api/history', methods=['GET'])
 def get_history():
-    """Get historical data from CSV"""
-    history = []
+    """Get historical data, newest first
     
-    with csv_lock:
-        if os.path.exists(DATA_FILE):
-            with open(DATA_FILE, 'r') as f:
-                reader = csv.DictReader(f)
-                for row in reader:
-                    history.append(row)
+    Query: since / until (Unix seconds or 'YYYY-MM-DD HH:MM:SS'), limit
+    (default 50) and resolution ('raw', '1m' or '1h' rollups).
+    """
+    device = get_device()
+    try:
+        since = request.args.get('since')
+        until = request.args.get('until')
+        limit = max(1, min(int(request.args.get('limit', 50)), HISTORY_MAX_LIMIT))
+        resolution = request.args.get('resolution', 'raw')
+        rows = history.query(device.id, since=parse_ts(since) if since else None,
+                             until=parse_ts(until) if until else None,
+                             limit=limit, resolution=resolution)
+        return jsonify(rows)
     
-    # Return last 50 entries, most recent first
-    return jsonify(history[-50:][::-1])
+    except ValueError as e:
+        return jsonify({'error': str(e)}), 400
 
 if __name__ == '__main__':
-    # Run on all interfaces so ESP8266 can connect
-    app.run(host='0.0.0.0', port=5001, debug=True)
+    # Run on all interfaces so ESP8266 can connect; threaded because long-polls
+    # and event streams each hold a request open
+    app.run(host='0.0.0.0', port=5001, debug=True, threaded=True)
@@ -0,0 +1,72 @@
+"""
+Sign Firmware - Signing keys and signed images for hub updates
+
+The hub fetches updates over plain HTTP from an unauthenticated endpoint, so
+it only boots an image signed with the key it was built with (the ESP8266
+core's signed updates: SHA-256 over the image, RSA PKCS#1 v1.5). The
+signature and its length ride at the end of the image:
+
+    image | signature | uint32 little-endian signature length
+
+which is the layout the core's own signing.py writes. Keys and signatures
+come from the openssl command line tool.
+
+    python3 sign_firmware.py keygen ~/hub-signing.key
+        New 2048-bit key pair; the public half goes into
+        firmware/include/ota_public_key.h for the next hub build. Keep the
+        private key off the server and out of the repository.
+
+    python3 sign_firmware.py sign ~/hub-signing.key firmware.bin.gz \\
+            firmware_images/hub-daikin.bin.gz
+        Signs an image (compress first: the signature covers the bytes the
+        hub downloads) and writes it ready to publish in hub.json.
+"""
+
+import os
+import struct
+import subprocess
+import sys
+
+PUBLIC_KEY_HEADER = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                 '..', 'firmware', 'include', 'ota_public_key.h')
+SIGNATURE_LENGTHS = (256, 384, 512)   # RSA-2048, -3072, -4096
+
+def image_signed(path, size):
+    """True when the image ends in a signature trailer (not that it verifies)"""
+    if size < 4:
+        return False
+    with open(path, 'rb') as f:
+        f.seek(size - 4)
+        length = struct.unpack('<I', f.read(4))[0]
+    return length in SIGNATURE_LENGTHS and size > length + 4
+
+def keygen(private_key):
+    subprocess.run(['openssl', 'genrsa', '-out', private_key, '2048'], check=True)
+    os.chmod(private_key, 0o600)
+    public_pem = subprocess.run(['openssl', 'rsa', '-in', private_key, '-pubout'],
+                                check=True, capture_output=True, text=True).stdout
+    with open(PUBLIC_KEY_HEADER, 'w') as f:
+        f.write('// Hub update signing key, written by server/sign_firmware.py keygen\n')
+        f.write('static const char otaPublicKey[] PROGMEM = R"KEY(\n%s)KEY";\n' % public_pem)
+    print('Private key: %s\nPublic key:  %s' % (private_key, os.path.normpath(PUBLIC_KEY_HEADER)))
+
+def sign(private_key, image, out):
+    with open(image, 'rb') as f:
+        data = f.read()
+    if image_signed(image, len(data)):
+        sys.exit('%s is already signed' % image)
+    signature = subprocess.run(['openssl', 'dgst', '-sha256', '-sign', private_key],
+                               input=data, check=True, capture_output=True).stdout
+    with open(out, 'wb') as f:
+        f.write(data)
+        f.write(signature)
+        f.write(struct.pack('<I', len(signature)))
+    print('Signed %s -> %s (%d B)' % (image, out, len(data) + len(signature) + 4))
+
+if __name__ == '__main__':
+    if len(sys.argv) == 3 and sys.argv[1] == 'keygen':
+        keygen(sys.argv[2])
+    elif len(sys.argv) == 5 and sys.argv[1] == 'sign':
+        sign(sys.argv[2], sys.argv[3], sys.argv[4])
+    else:
+        sys.exit(__doc__)